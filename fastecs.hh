@@ -4,19 +4,26 @@
 #define ECS_VERSION "0.3.3"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <condition_variable>
 #include <chrono>
+#include <cstring>
+#include <deque>
 #include <functional>
+#include <iterator>
 #include <limits>
 #include <map>
+#include <memory>
 #include <mutex>
-#include <set>
+#include <optional>
 #include <sstream>
 #include <string>
 #include <variant>
 #include <unordered_map>
 #include <thread>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #ifndef NOABI
@@ -26,11 +33,104 @@
 namespace ecs {
 
 enum class Threading { Single, Multi };
+enum class Order     { ByPool, ById };   // the order of the entities of all pools: pool after pool, or merged by id
 enum class NoPool {};
 struct     NoGlobal {};
 using      NoMessageQueue = std::variant<std::nullptr_t>;
 using      SystemPtr = int16_t;
 
+// {{{ pools
+
+// Restricts the components that can be added to entities in the pool `P`.
+template <auto P, typename... C>
+struct PoolComponents {
+    static_assert(std::is_enum_v<decltype(P)>, "PoolComponents must be given a pool.");
+
+    static constexpr size_t index = static_cast<size_t>(P);
+
+    template <typename T>
+    static constexpr bool contains = (std::is_same_v<T, C> || ...);
+
+    template <typename T, typename... All>
+    static constexpr bool one_of = (std::is_same_v<T, All> || ...);
+
+    template <typename... All>
+    static constexpr bool uses_only = (one_of<C, All...> && ...);
+};
+
+// Stores the pool in the highest bits of the entity id, so the components of an id
+// can be found without looking up the pool of the entity.
+struct PoolInId {};
+
+// options that are not a `PoolComponents` don't restrict any pool
+template <typename O>
+struct pool_restriction {
+    static constexpr size_t index = std::numeric_limits<size_t>::max();
+
+    template <typename T>
+    static constexpr bool contains = false;
+
+    template <typename... All>
+    static constexpr bool uses_only = true;
+};
+
+template <auto P, typename... C>
+struct pool_restriction<PoolComponents<P, C...>> : PoolComponents<P, C...> {};
+
+// Pools declared with a compile-time count are stored in a fixed array, so
+// finding the storage of a pool is a simple index. The enum values must be
+// in the range [0, N). `Options` is an optional list of `PoolComponents`
+// and `PoolInId`.
+template <typename E, size_t N, typename... Options>
+struct Pools {
+    static_assert(std::is_enum_v<E>, "Pool must be an enum.");
+    static_assert(N < static_cast<size_t>(std::numeric_limits<std::underlying_type_t<E>>::max()),
+                  "Too many pools for the enum underlying type.");
+    static_assert(((pool_restriction<Options>::index < N || std::is_same_v<Options, PoolInId>) && ...),
+                  "PoolComponents refers to a pool out of range.");
+};
+
+// When a plain enum is used, pools are registered as they are used.
+template <typename P>
+struct pool_traits {
+    using type = P;
+    static constexpr bool   fixed = false;
+    static constexpr size_t count = 0;
+    static constexpr bool   pool_in_id = false;
+
+    template <typename C>
+    static constexpr bool allows(size_t) { return true; }
+
+    template <typename... All>
+    static constexpr bool uses_only = true;
+};
+
+template <typename E, size_t N, typename... Options>
+struct pool_traits<Pools<E, N, Options...>> {
+    using type = E;
+    static constexpr bool   fixed = true;
+    static constexpr size_t count = N;
+    static constexpr bool   pool_in_id = (std::is_same_v<Options, PoolInId> || ...);
+
+    // true if the component C can be added to the pool in slot `idx` (the default pool, in
+    // the last slot, and the pools without restrictions accept any component)
+    template <typename C>
+    static constexpr bool allows([[maybe_unused]] size_t idx) {
+        bool restricted = false, found = false;
+        ((pool_restriction<Options>::index == idx
+            ? (restricted = true, found = found || pool_restriction<Options>::template contains<C>) : false), ...);
+        return !restricted || found;
+    }
+
+    template <typename... All>
+    static constexpr bool uses_only = (pool_restriction<Options>::template uses_only<All...> && ...);
+};
+
+template <>
+struct pool_traits<NoPool> : pool_traits<Pools<NoPool, 0>> {};
+
+// }}}
+
 // {{{ exception class
 
 class ECSError : public std::runtime_error {
@@ -88,19 +188,100 @@ static std::string debug_object(Obj const& obj) {
 
 // {{{ entity classes
 
+// A compact reference to an entity, that can be stored in components. It is
+// trivially copyable, and becomes invalid when the entity is removed.
+struct EntityHandle {
+    uint32_t index      = std::numeric_limits<uint32_t>::max();
+    uint32_t generation = 0;
+
+    bool operator==(EntityHandle const& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(EntityHandle const& other) const { return !(*this == other); }
+};
+static_assert(sizeof(EntityHandle) == 8 && std::is_trivially_copyable_v<EntityHandle>);
+
+// A component declared as `Shared<C>` is stored only once for all entities with identical values,
+// and is read-only: `get<Shared<C>>()` returns a `C const&`.
+template <typename C>
+struct Shared {};
+
+// A component declared as `Split<Hot, Cold>` has its two parts stored in separate arrays, so that
+// iterating the entities and reading the hot part never loads the cold part into the cache.
+// `get<Split<Hot, Cold>>()` returns a `SplitRef`, that gives access to both parts.
+template <typename Hot, typename Cold>
+struct Split {};
+
+template <typename Hot, typename Cold>
+class SplitRef {
+public:
+    SplitRef() = default;
+    SplitRef(Hot* hot, Cold* cold) : _hot(hot), _cold(cold) {}
+
+    Hot&  hot() const                       { return *_hot; }
+    Cold& cold() const                      { return *_cold; }
+
+    // a SplitRef is also used as the pointer returned by `get_ptr`
+    explicit operator bool() const          { return _hot != nullptr; }
+    SplitRef const* operator->() const      { return this; }
+    SplitRef const& operator*() const       { return *this; }
+
+private:
+    Hot*  _hot  = nullptr;
+    Cold* _cold = nullptr;
+};
+
+// the types returned when a component is accessed
+template <typename C>
+struct component_type {
+    using reference       = C&;
+    using const_reference = C const&;
+    using pointer         = C*;
+    using const_pointer   = C const*;
+    static C* address(C& c)                 { return &c; }
+    static C const* address(C const& c)     { return &c; }
+};
+
+template <typename C>
+struct component_type<Shared<C>> {
+    using reference       = C const&;
+    using const_reference = C const&;
+    using pointer         = C const*;
+    using const_pointer   = C const*;
+    static C const* address(C const& c)     { return &c; }
+};
+
+template <typename Hot, typename Cold>
+struct component_type<Split<Hot, Cold>> {
+    using reference       = SplitRef<Hot, Cold>;
+    using const_reference = SplitRef<Hot const, Cold const>;
+    using pointer         = reference;
+    using const_pointer   = const_reference;
+    static reference address(reference r)               { return r; }
+    static const_reference address(const_reference r)   { return r; }
+};
+
+template <typename C> using ComponentRef      = typename component_type<C>::reference;
+template <typename C> using ComponentConstRef = typename component_type<C>::const_reference;
+template <typename C> using ComponentPtr      = typename component_type<C>::pointer;
+template <typename C> using ComponentConstPtr = typename component_type<C>::const_pointer;
+
 template<typename ECS, typename Pool>
 class ConstEntity {
 public:
-    ConstEntity(size_t id, Pool pool, ECS const* ecs)
+    ConstEntity(typename ECS::Id id, Pool pool, ECS const* ecs)
             : id(id), pool(pool), ecs(ecs) {}
 
-    template<typename C>
-    C const& get() const {
-        return ecs->template component<C>(id, pool);
+    // with more than one component, returns a tuple of references
+    template<typename C, typename... Cs>
+    std::conditional_t<sizeof...(Cs) == 0, ComponentConstRef<C>, std::tuple<ComponentConstRef<C>, ComponentConstRef<Cs>...>>
+    get() const {
+        if constexpr (sizeof...(Cs) == 0)
+            return ecs->template component<C>(id, pool);
+        else
+            return ecs->template components<C, Cs...>(id, pool);
     }
 
     template<typename C>
-    C const* get_ptr() const {
+    ComponentConstPtr<C> get_ptr() const {
         return ecs->template component_ptr<C>(id, pool);
     }
 
@@ -113,14 +294,18 @@ public:
         return ecs->debug_entity(id, pool);
     }
 
+    [[nodiscard]] EntityHandle handle() const {
+        return ecs->handle(id);
+    }
+
     bool operator==(ConstEntity const& other) const { return id == other.id; }
     bool operator!=(ConstEntity const& other) const { return id != other.id; }
     bool operator<(ConstEntity const& other) const { return id < other.id; }
 
-    size_t id;   // TODO - make these two fields const
+    typename ECS::Id id;   // TODO - make these two fields const
     Pool pool;
 
-private:
+protected:
     ECS const* ecs;
 };
 
@@ -128,31 +313,36 @@ private:
 template<typename ECS, typename Pool>
 class Entity : public ConstEntity<ECS, Pool> {
 public:
-    Entity(size_t id, Pool pool, ECS* ecs)
-            : ConstEntity<ECS, Pool>(id, pool, ecs), ecs(ecs) {}
+    Entity(typename ECS::Id id, Pool pool, ECS* ecs)
+            : ConstEntity<ECS, Pool>(id, pool, ecs) {}
 
     template<typename C, typename... P>
-    C& add(P&& ...pars) {
-        return ecs->template add_component<C>(this->id, this->pool, pars...);
+    ComponentRef<C> add(P&& ...pars) {
+        return mutable_ecs()->template add_component<C>(this->id, this->pool, std::forward<P>(pars)...);
     }
 
-    template<typename C>
-    C& get() {
-        return ecs->template component<C>(this->id, this->pool);
+    template<typename C, typename... Cs>
+    std::conditional_t<sizeof...(Cs) == 0, ComponentRef<C>, std::tuple<ComponentRef<C>, ComponentRef<Cs>...>>
+    get() {
+        if constexpr (sizeof...(Cs) == 0)
+            return mutable_ecs()->template component<C>(this->id, this->pool);
+        else
+            return mutable_ecs()->template components<C, Cs...>(this->id, this->pool);
     }
 
     template<typename C>
-    C* get_ptr() {
-        return ecs->template component_ptr<C>(this->id, this->pool);
+    ComponentPtr<C> get_ptr() {
+        return mutable_ecs()->template component_ptr<C>(this->id, this->pool);
     }
 
     template<typename C>
     void remove() {
-        ecs->template remove_component<C>(this->id, this->pool);
+        mutable_ecs()->template remove_component<C>(this->id, this->pool);
     }
 
 private:
-    ECS* ecs;
+    // an Entity is only created from a non-const ECS, so this is safe
+    ECS* mutable_ecs() const { return const_cast<ECS*>(this->ecs); }
 };
 
 
@@ -163,770 +353,3402 @@ bool operator!=(Entity<ECS, Pool> const& a, ConstEntity<ECS, Pool> const& b) { r
 
 // }}}
 
-// {{{ synchronized queue
+// {{{ component storage
+
+// Components that can be moved in memory with `memmove`, with no need to call their move constructor
+// and destructor. By default, these are the trivially copyable types, but other types can opt in by
+// specializing this trait (this is safe for most types, as long as they don't keep pointers to themselves):
+//
+//     template<> struct ecs::is_trivially_relocatable<MyComponent> : std::true_type {};
+//
+template <typename C>
+struct is_trivially_relocatable : std::is_trivially_copyable<C> {};
+
+// Components that, when removed, are kept in a free list (with the memory they allocated, such as the
+// capacity of their vectors), to be reused by a later `add`. To opt in, specialize this trait with a
+// `reset` function that receives a recycled component and the parameters given to `add`:
+//
+//     template<> struct ecs::recycle_traits<Polygon> {
+//         static constexpr bool enabled = true;
+//         static void reset(Polygon& p) { p.points.clear(); p.description.clear(); }
+//     };
+//
+// If there's no `reset` for the parameters given to `add`, the component is created as usual. The free
+// list of each pool keeps at most `max_free` components (1024 if the trait doesn't define it).
+template <typename C>
+struct recycle_traits {
+    static constexpr bool enabled = false;
+};
 
+template <typename C, typename = void>
+struct recycle_max_free : std::integral_constant<size_t, 1024> {};
+
+template <typename C>
+struct recycle_max_free<C, std::void_t<decltype(recycle_traits<C>::max_free)>>
+        : std::integral_constant<size_t, recycle_traits<C>::max_free> {};
+
+template <typename C, typename Pars, typename = void>
+struct can_recycle : std::false_type {};
+
+template <typename C, typename... P>
+struct can_recycle<C, std::tuple<P...>, std::void_t<decltype(recycle_traits<C>::reset(std::declval<C&>(), std::declval<P>()...))>>
+        : std::bool_constant<recycle_traits<C>::enabled> {};
+
+// Components whose changes are recorded, so that they can be used in the `Changed`, `Added` filters and
+// in `removed()`. Each tracked component costs two ticks per entity id. To opt in:
+//
+//     template<> struct ecs::track_changes<Position> : std::true_type {};
+//
+template <typename C>
+struct track_changes : std::false_type {};
+
+// Components that can have observers (`on_add`, `on_remove`...). The other components don't check for
+// observers when they are added or removed. To opt in:
+//
+//     template<> struct ecs::observe<Position> : std::true_type {};
+//
+template <typename C>
+struct observe : std::false_type {};
+
+// A vector for trivially relocatable types, that shifts and grows using `memmove`.
 template <typename T>
-class SyncQueue {
+class RelocatableVector {
 public:
-    void push_sync(const T& item, SystemPtr const& current_system)
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        queue_.push_back({ item, current_system });
+    RelocatableVector() = default;
+    RelocatableVector(RelocatableVector const&) = delete;
+    RelocatableVector& operator=(RelocatableVector const&) = delete;
+
+    RelocatableVector(RelocatableVector&& other) noexcept
+            : _data(std::exchange(other._data, nullptr)), _size(std::exchange(other._size, 0)),
+              _capacity(std::exchange(other._capacity, 0)) {}
+
+    RelocatableVector& operator=(RelocatableVector&& other) noexcept {
+        if (this != &other) {
+            release();
+            _data = std::exchange(other._data, nullptr);
+            _size = std::exchange(other._size, 0);
+            _capacity = std::exchange(other._capacity, 0);
+        }
+        return *this;
     }
 
-    void push_sync(T&& item, SystemPtr const& current_system)
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        queue_.push_back({ std::move(item), current_system });
+    ~RelocatableVector() { release(); }
+
+    size_t   size() const                   { return _size; }
+    T*       begin()                        { return _data; }
+    T*       end()                          { return _data + _size; }
+    T&       operator[](size_t i)           { return _data[i]; }
+    T const& operator[](size_t i) const     { return _data[i]; }
+
+    void reserve(size_t n) {
+        // {{{ ...
+        if (n <= _capacity)
+            return;
+        T* data = std::allocator<T>().allocate(n);
+        if (_data)
+            std::memcpy(static_cast<void*>(data), static_cast<void const*>(_data), _size * sizeof(T));
+        deallocate();
+        _data = data;
+        _capacity = n;
+        // }}}
     }
 
-    void push_nosync(const T& item, SystemPtr const& current_system)
-    {
-        queue_.push_back({ item, current_system });
+    template <typename... P>
+    T* emplace(T* pos, P&& ...pars) {
+        // {{{ ...
+        // the parameters might refer to an element, that is moved when the gap is opened
+        T value(std::forward<P>(pars)...);
+        size_t i = open_gap(pos, 1);
+        try {
+            ::new (static_cast<void*>(_data + i)) T(std::move(value));
+        } catch (...) {
+            close_gap(i, 1);
+            throw;
+        }
+        ++_size;
+        return _data + i;
+        // }}}
     }
 
-    void push_nosync(T&& item, SystemPtr const& current_system)
-    {
-        queue_.push_back({ std::move(item), current_system });
+    template <typename... P>
+    T& emplace_back(P&& ...pars)            { return *emplace(end(), std::forward<P>(pars)...); }
+    void push_back(T&& value)               { emplace(end(), std::move(value)); }
+    T* insert(T* pos, T&& value)            { return emplace(pos, std::move(value)); }
+
+    template <typename It>
+    void insert(T* pos, It first, It last) {
+        // {{{ ...
+        size_t n = static_cast<size_t>(std::distance(first, last));
+        size_t i = open_gap(pos, n);
+        for (size_t k = 0; k < n; ++k, ++first)
+            ::new (static_cast<void*>(_data + i + k)) T(*first);
+        _size += n;
+        // }}}
     }
 
-    std::vector<std::pair<T, SystemPtr>> const& underlying_vector() const {
-        return queue_;
+    void erase(T* pos) {
+        // {{{ ...
+        size_t i = static_cast<size_t>(pos - _data);
+        pos->~T();
+        --_size;
+        close_gap(i, 1);
+        // }}}
+    }
+
+    void erase(T* first, T* last) {
+        // {{{ ...
+        size_t i = static_cast<size_t>(first - _data), n = static_cast<size_t>(last - first);
+        for (T* p = first; p != last; ++p)
+            p->~T();
+        _size -= n;
+        close_gap(i, n);
+        // }}}
     }
 
     void clear() {
-        std::lock_guard<std::mutex> lock(mutex_);
-        queue_.clear();
+        for (size_t i = 0; i < _size; ++i)
+            _data[i].~T();
+        _size = 0;
     }
 
-    void clear_with_system(SystemPtr const& system_ptr) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        queue_.erase(std::remove_if(queue_.begin(), queue_.end(),
-                                [&system_ptr](std::pair<T, SystemPtr> const& t) { return t.second == system_ptr; }),
-                     queue_.end());
+private:
+    // moves the elements from `pos` to the end `n` positions forward, returning the index of `pos`
+    size_t open_gap(T* pos, size_t n) {
+        size_t i = static_cast<size_t>(pos - _data);
+        if (_size + n > _capacity)
+            reserve(std::max(_size + n, _capacity * 2));
+        if (i < _size)
+            std::memmove(static_cast<void*>(_data + i + n), static_cast<void const*>(_data + i), (_size - i) * sizeof(T));
+        return i;
     }
 
-    template<typename U>
-    void clear_with_type() {
-        queue_.erase(std::remove_if(queue_.begin(), queue_.end(),
-                     [](std::pair<T, SystemPtr> const& t) { return std::holds_alternative<U>(t.first); }),
-                     queue_.end());
+    // moves the elements after the gap in `i` back `n` positions (`_size` doesn't count the gap)
+    void close_gap(size_t i, size_t n) {
+        if (i < _size)
+            std::memmove(static_cast<void*>(_data + i), static_cast<void const*>(_data + i + n), (_size - i) * sizeof(T));
     }
 
-    size_t size() const {
-        std::lock_guard<std::mutex> lock(mutex_);
-        return queue_.size();
+    void deallocate() {
+        if (_data)
+            std::allocator<T>().deallocate(_data, _capacity);
     }
 
-private:
-    std::vector<std::pair<T, SystemPtr>> queue_ {};
-    mutable std::mutex mutex_ {};
+    void release() {
+        clear();
+        deallocate();
+        _data = nullptr;
+        _capacity = 0;
+    }
+
+    T*     _data     = nullptr;
+    size_t _size     = 0;
+    size_t _capacity = 0;
 };
 
-// }}}
+// How the components of a type are stored.
+enum class Storage {
+    Dense,    // sorted array: the fastest to iterate
+    Tag,      // only the entity ids, for components without data
+    Sparse,   // hash table: adding and removing doesn't move the other components
+    Stable,   // each component is allocated separately, so its address never changes
+};
 
-// {{{ timer
+// Chooses how a component is stored. It can be specialized to choose another storage:
+//
+//     template<> struct ecs::storage_traits<Selected> { static constexpr ecs::Storage kind = ecs::Storage::Sparse; };
+//
+template <typename C>
+struct storage_traits;
 
-struct SystemTime {
-    std::string               name;
-    std::chrono::microseconds us;
-};
+template <typename Id, typename C, Storage Kind = storage_traits<C>::kind> class ComponentStorage;
 
-class Timer {
+// Memory shared by the `Buffer` components of one pool, for the buffers that outgrow their inline storage.
+template <typename T>
+class BufferArena {
 public:
-    void start_frame() {
-        std::lock_guard<std::mutex> lock(mutex_);
-        ++_iterations;
-    }
+    T*     data()                           { return _data.data(); }
+    size_t size() const                     { return _data.size(); }
+    size_t garbage() const                  { return _garbage; }
 
-    void reset() {
-        std::lock_guard<std::mutex> lock(mutex_);
-        _timer_mt.clear();
-        _timer_st.clear();
-        _iterations = 0;
+    size_t allocate(size_t n) {
+        // {{{ ...
+        // reuse a released block of the same size (the buffers grow by doubling, so the sizes repeat)
+        auto it = _released.find(n);
+        if (it != _released.end() && !it->second.empty()) {
+            size_t offset = it->second.back();
+            it->second.pop_back();
+            _garbage -= n;
+            return offset;
+        }
+        size_t offset = _data.size();
+        _data.resize(offset + n);
+        return offset;
+        // }}}
     }
 
-    void add_time(std::string const& name, std::chrono::microseconds us, bool mt) {
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            auto& timer = mt ? _timer_mt : _timer_st;
-            auto it = std::find_if(timer.begin(), timer.end(),
-                                   [&name](SystemTime const& s) { return s.name == name; });
-            if (it == timer.end())
-                timer.push_back({ name, us });
-            else
-                it->us += us;
-        }
-        if (mt)
-            add_time("multithreaded", us, false);
+    void release(size_t offset, size_t n) {
+        _garbage += n;
+        _released[n].push_back(offset);
     }
 
-    [[nodiscard]] std::vector<SystemTime> timer(bool mt) const {
-        auto& timer = (mt ? _timer_mt : _timer_st);
-        std::vector<SystemTime> t(timer.begin(), timer.end());
-        for (auto& [_, us]: t)
-            us /= _iterations;
-        return t;
+    void reset(std::vector<T>&& data) {
+        _data = std::move(data);
+        _garbage = 0;
+        _released.clear();
     }
 
 private:
-    std::vector<SystemTime> _timer_mt {};
-    std::vector<SystemTime> _timer_st {};
-    size_t _iterations = 0;
-    std::mutex mutex_ {};
+    std::vector<T>                                  _data     {};
+    size_t                                          _garbage  = 0;
+    std::unordered_map<size_t, std::vector<size_t>> _released {};   // offsets of the free blocks, by size
 };
 
-// }}}
+// A component that contains a dynamic array of `T` (such as a path, or an inventory). The first `N` elements
+// are stored inside the component, and when the buffer grows beyond that, the elements are stored in an arena
+// shared by all buffers of the pool, instead of being allocated separately. `T` must be trivially copyable.
+// To have more than one buffer of the same type, inherit from it: `struct Path : ecs::Buffer<Point, 8> {};`
+template <typename T, size_t N>
+class Buffer {
+    static_assert(std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T>,
+                  "Buffer elements must be trivially copyable.");
+    static_assert(N > 0, "Buffer needs at least one inline element.");
+public:
+    using buffer_value_type = T;
 
-template <typename Global, typename Message, typename Pool, typename... Components>
-class ECS {
-    using MyECS = ECS<Global, Message, Pool, Components...>;
+    Buffer() = default;
+    Buffer(Buffer const&) = delete;
+    Buffer& operator=(Buffer const&) = delete;
 
-public:
-    using EntityType = Entity<MyECS, Pool>;
-    using ConstEntityType = ConstEntity<MyECS, Pool>;
+    Buffer(Buffer&& other) noexcept { steal(other); }
 
-    static const char* version() { return ECS_VERSION; }
+    Buffer& operator=(Buffer&& other) noexcept {
+        if (this != &other) {
+            release();
+            steal(other);
+        }
+        return *this;
+    }
 
-    template <typename... P>
-    explicit ECS(P&& ...pars)
-            : _global(Global { pars... }) {}
+    ~Buffer() { release(); }
 
-    ~ECS() { join(); }
+    size_t   size() const                   { return _size; }
+    bool     empty() const                  { return _size == 0; }
+    size_t   capacity() const               { return _capacity; }
 
-    void set_threading(Threading t)         { _threading = t; }
+    T*       data()                         { return on_arena() ? _arena->data() + _offset : _inline.data(); }
+    T const* data() const                   { return on_arena() ? _arena->data() + _offset : _inline.data(); }
+    T*       begin()                        { return data(); }
+    T*       end()                          { return data() + _size; }
+    T const* begin() const                  { return data(); }
+    T const* end() const                    { return data() + _size; }
+    T&       operator[](size_t i)           { return data()[i]; }
+    T const& operator[](size_t i) const     { return data()[i]; }
 
-    //
-    // entities
-    //
+    void push_back(T const& value) {
+        T copy = value;   // `value` might be an element of this buffer, that `reallocate` releases
+        if (_size == _capacity)
+            reallocate(_capacity * 2);
+        data()[_size++] = copy;
+    }
 
-    Entity<MyECS, Pool> add() {
+    void pop_back()                         { --_size; }
+    void clear()                            { _size = 0; }
+
+private:
+    template <typename, typename, Storage> friend class ComponentStorage;
+
+    bool on_arena() const                   { return _capacity > N; }
+
+    void reallocate(size_t capacity) {
         // {{{ ...
-        _entity_pools.at(DefaultPool).emplace(_next_entity_id, DefaultPool);
-        _entities.emplace(_next_entity_id, DefaultPool);
-        return Entity<MyECS, Pool>(_next_entity_id++, DefaultPool, this);
+        if (_arena == nullptr)
+            throw ECSError("A Buffer can only grow beyond its inline size after being added to an entity.");
+        size_t offset = _arena->allocate(capacity);   // might move the arena, so `data()` is only read after this
+        std::copy(data(), data() + _size, _arena->data() + offset);
+        if (on_arena())
+            _arena->release(_offset, _capacity);
+        _offset = offset;
+        _capacity = static_cast<uint32_t>(capacity);
         // }}}
     }
 
-    Entity<MyECS, Pool> add(Pool pool) {
+    // move the elements to the arena of another pool
+    void attach(BufferArena<T>* arena) {
         // {{{ ...
-        auto it = _entity_pools.insert({ pool, {} }).first;
-        it->second.emplace(_next_entity_id, pool);
-        _entities.emplace(_next_entity_id, pool);
-        _pool_set.insert(pool);
-        _components.insert({ pool, {} });
-        return Entity<MyECS, Pool>(_next_entity_id++, pool, this);
+        if (on_arena() && arena != _arena) {
+            size_t offset = arena->allocate(_capacity);
+            std::copy(data(), data() + _size, arena->data() + offset);
+            _arena->release(_offset, _capacity);
+            _offset = offset;
+        }
+        _arena = arena;
         // }}}
     }
 
-    Entity<MyECS, Pool> get(size_t id) {
-        // {{{
-        auto it = _entities.find(id);
-        if (it == _entities.end())
-            throw ECSError("Id " + std::to_string(id) + " not found.");
-        return Entity<MyECS, Pool>(id, it->second, this);
+    // copy the elements to the new (compacted) memory of the arena
+    void compact_to(std::vector<T>& data) {
+        // {{{ ...
+        if (on_arena()) {
+            size_t offset = data.size();
+            data.insert(data.end(), this->data(), this->data() + _capacity);
+            _offset = offset;
+        }
         // }}}
     }
 
-    template <typename Component>
-    Component& get(size_t id) {
-        // {{{
-        return get(id).template get<Component>();
+    void steal(Buffer& other) {
+        // {{{ ...
+        _inline = other._inline;
+        _size = std::exchange(other._size, 0);
+        _capacity = std::exchange(other._capacity, static_cast<uint32_t>(N));
+        _offset = other._offset;
+        _arena = other._arena;
         // }}}
     }
 
-    template<typename Component>
-    Component* get_ptr(size_t id) const {
-        // {{{
-        return get(id).template get_ptr<Component>();
-        // }}}
+    void release() {
+        if (on_arena())
+            _arena->release(_offset, _capacity);
+        _size = 0;
+        _capacity = N;
     }
 
-    template <typename Component>
-    bool has(size_t id) {
-        // {{{
-        return get(id).template has<Component>();
-        // }}}
-    }
+    std::array<T, N> _inline   {};
+    uint32_t         _size     = 0;
+    uint32_t         _capacity = N;
+    size_t           _offset   = 0;
+    BufferArena<T>*  _arena    = nullptr;
+};
 
-    ConstEntity<MyECS, Pool> get(size_t id) const {
-        // {{{
-        auto it = _entities.find(id);
-        if (it == _entities.end())
-            throw ECSError("Id " + std::to_string(id) + " not found.");
-        return ConstEntity<MyECS, Pool>(id, it->second, this);
-        // }}}
-    }
+template <typename C, typename = void>
+struct is_buffer : std::false_type {
+    using value_type = void;
+};
 
-    template <typename Component>
-    Component const& get(size_t id) const {
-        // {{{
-        return get(id).template get<Component>();
-        // }}}
-    }
+template <typename C>
+struct is_buffer<C, std::void_t<typename C::buffer_value_type>> : std::true_type {
+    using value_type = typename C::buffer_value_type;
+};
 
-    bool exists(size_t id) {
-        // {{{
-        auto it = _entities.find(id);
-        return it != _entities.end();
-        // }}}
+// By default, empty components are tags, and large components that are expensive to move are stable.
+template <typename C>
+struct storage_traits {
+    static constexpr Storage kind =
+        std::is_empty_v<C> ? Storage::Tag :
+        (sizeof(C) > 128 && !is_trivially_relocatable<C>::value && !is_buffer<C>::value && !recycle_traits<C>::enabled) ? Storage::Stable :
+        Storage::Dense;
+};
+
+template <typename C>
+struct storage_traits<Shared<C>> { static constexpr Storage kind = Storage::Dense; };
+
+template <typename Hot, typename Cold>
+struct storage_traits<Split<Hot, Cold>> { static constexpr Storage kind = Storage::Dense; };
+
+// a unique_ptr only contains a pointer, so it can be moved in memory
+template <typename T>
+struct is_trivially_relocatable<std::unique_ptr<T>> : std::true_type {};
+
+// The sorted column of entity ids, common to all component storages. When the component
+// is owned by a group, the ids are split in two sorted runs: first the entities that are
+// part of the group (in the same order in all the storages of the group), then the rest.
+template <typename Id>
+class IdColumn {
+public:
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+    size_t size() const                     { return _ids.size(); }
+    bool   empty() const                    { return _ids.empty(); }
+    size_t group_size() const               { return _split; }
+
+    std::vector<Id> const& ids() const      { return _ids; }
+
+    // position where a new id is inserted (always outside of the group)
+    size_t lower_bound(Id id) const {
+        return static_cast<size_t>(std::lower_bound(_ids.begin() + static_cast<std::ptrdiff_t>(_split), _ids.end(), id) - _ids.begin());
     }
 
-    void remove(Entity<MyECS, Pool> const& entity) {
+    // returns the position of the component of the entity, or `npos`
+    size_t find(Id id) const {
         // {{{ ...
-        for (auto& [_, pool_map]: _entity_pools)
-            pool_map.erase(entity.id);
-        _entities.erase(entity.id);
+        if (_split > 0) {
+            auto it = std::lower_bound(_ids.begin(), _ids.begin() + static_cast<std::ptrdiff_t>(_split), id);
+            if (it != _ids.begin() + static_cast<std::ptrdiff_t>(_split) && *it == id)
+                return static_cast<size_t>(it - _ids.begin());
+        }
+        size_t i = lower_bound(id);
+        return (i < _ids.size() && _ids[i] == id) ? i : npos;
         // }}}
     }
 
-    //
-    // iteration
-    //
-
-    std::vector<Entity<ECS, Pool>> entities() {
+    // true if one of the `ids` (which must be sorted) is in the column, from the position `from`
+    bool contains_any(std::vector<Id> const& ids, size_t from = 0) const {
         // {{{ ...
-        return find_matching_entities(_pool_set);
+        auto it = _ids.begin() + static_cast<std::ptrdiff_t>(from);
+        auto id_it = ids.begin();
+        while (it != _ids.end() && id_it != ids.end()) {
+            if (*it < *id_it)
+                ++it;
+            else if (*id_it < *it)
+                ++id_it;
+            else
+                return true;
+        }
+        return false;
         // }}}
     }
 
-    std::vector<Entity<ECS, Pool>> entities(Pool pool) {
-        // {{{ ...
-        _pool_set.insert(pool);
-        return find_matching_entities(std::vector<Pool> { pool });
-        // }}}
+protected:
+    // removes the ids that are also in `ids` (which must be sorted), and returns them
+    std::vector<Id> take_ids(std::vector<Id> const& ids) {
+        std::vector<Id> taken, kept;
+        std::set_intersection(_ids.begin(), _ids.end(), ids.begin(), ids.end(), std::back_inserter(taken));
+        std::set_difference(_ids.begin(), _ids.end(), ids.begin(), ids.end(), std::back_inserter(kept));
+        _ids = std::move(kept);
+        return taken;
     }
 
-    template <typename... T>
-    std::vector<Entity<ECS, Pool>> entities() {
+    // adds sorted ids to the column
+    void merge_ids(std::vector<Id> const& ids) {
+        size_t n = _ids.size();
+        _ids.insert(_ids.end(), ids.begin(), ids.end());
+        if (n > 0 && !ids.empty() && ids.front() < _ids[n - 1])
+            std::inplace_merge(_ids.begin(), _ids.begin() + static_cast<std::ptrdiff_t>(n), _ids.end());
+    }
+
+    std::vector<Id> _ids   {};
+    size_t          _split = 0;
+};
+
+// Filters that can be used in the component list of `entities`, `query` and `each`: `With<C>` is the same
+// as `C`, `Without<C>` skips the entities that have the component, and `Maybe<C>` doesn't filter, but gives
+// a pointer to the component (or nullptr) in `each`.
+template <typename C> struct With {};
+template <typename C> struct Without {};
+template <typename C> struct Maybe {};
+
+// Filters for components with `track_changes`, that require the component to have been added (or
+// changed, including added) since the last time the system that is running ran.
+template <typename C> struct Added {};
+template <typename C> struct Changed {};
+
+enum class FilterKind { Required, Excluded, Optional };
+enum class ChangeFilter { None, Added, Changed };
+
+template <typename F> struct filter_traits {
+    using component = F;
+    static constexpr FilterKind   kind   = FilterKind::Required;
+    static constexpr ChangeFilter change = ChangeFilter::None;
+};
+template <typename C> struct filter_traits<With<C>>    : filter_traits<C> {};
+template <typename C> struct filter_traits<Without<C>> : filter_traits<C> { static constexpr FilterKind kind = FilterKind::Excluded; };
+template <typename C> struct filter_traits<Maybe<C>>   : filter_traits<C> { static constexpr FilterKind kind = FilterKind::Optional; };
+template <typename C> struct filter_traits<Added<C>>   : filter_traits<C> { static constexpr ChangeFilter change = ChangeFilter::Added; };
+template <typename C> struct filter_traits<Changed<C>> : filter_traits<C> { static constexpr ChangeFilter change = ChangeFilter::Changed; };
+
+template <typename F>
+using filter_component_t = typename filter_traits<F>::component;
+
+// Walks the ids of a storage in order, merging the two runs when the component is owned by a group.
+template <typename Id>
+class IdCursor {
+public:
+    IdCursor() = default;
+    IdCursor(std::vector<Id> const& ids, size_t split)
+            : _base(ids.data()), _a(ids.data()), _a_end(ids.data() + split), _b(ids.data() + split), _b_end(ids.data() + ids.size()) {}
+
+    bool   done() const                     { return _a == _a_end && _b == _b_end; }
+    Id     id() const                       { return in_first_run() ? *_a : *_b; }
+    size_t position() const                 { return static_cast<size_t>((in_first_run() ? _a : _b) - _base); }
+    void next()                             { if (in_first_run()) ++_a; else ++_b; }
+
+    size_t size() const                     { return static_cast<size_t>(_b_end - _base); }
+
+    // advances to the first id that is not lower than `id`
+    void seek(Id id) {
+        while (_a != _a_end && *_a < id)
+            ++_a;
+        while (_b != _b_end && *_b < id)
+            ++_b;
+    }
+
+    // the same as `seek`, for ids that are probably far away: the steps double until passing the id,
+    // and then the last step is searched
+    void gallop(Id id) {
+        gallop(_a, _a_end, id);
+        gallop(_b, _b_end, id);
+    }
+
+private:
+    static void gallop(Id const*& it, Id const* end, Id id) {
+        size_t step = 1;
+        Id const* from = it;
+        while (static_cast<size_t>(end - from) > step && from[step] < id) {
+            from += step;
+            step *= 2;
+        }
+        it = std::lower_bound(from, from + std::min(step + 1, static_cast<size_t>(end - from)), id);
+    }
+
+    bool in_first_run() const               { return _b == _b_end || (_a != _a_end && *_a < *_b); }
+
+    Id const *_base = nullptr, *_a = nullptr, *_a_end = nullptr, *_b = nullptr, *_b_end = nullptr;
+};
+
+// The ticks when a tracked component was added and last changed, indexed by the entity id (without the
+// pool, when it's in the id), and the components removed. The highest tick of each block of ids is also kept, so that the queries can
+// skip a whole block of entities that didn't change.
+template <typename Id>
+class ChangeTicks {
+public:
+    static constexpr size_t BlockSize = 64;
+
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+    void add(size_t i, uint64_t tick) {
+        grow(i);
+        _added[i] = tick;
+        _blocks[i / BlockSize].added = tick;
+        change(i, tick);
+    }
+
+    void change(size_t i, uint64_t tick) {
+        grow(i);
+        _changed[i] = tick;
+        _blocks[i / BlockSize].changed = tick;
+    }
+
+    void remove(Id id, uint64_t tick)       { _removed.emplace_back(id, tick); }
+
+    bool since(size_t i, uint64_t tick, ChangeFilter f) const {
+        auto const& ticks = f == ChangeFilter::Added ? _added : _changed;
+        return i < ticks.size() && ticks[i] > tick;
+    }
+
+    // the first index, not lower than `i`, in a block that changed after `tick` (or npos)
+    size_t next_in_changed_block(size_t i, uint64_t tick, ChangeFilter f) const {
+        size_t b = i / BlockSize;
+        while (b < _blocks.size() && (f == ChangeFilter::Added ? _blocks[b].added : _blocks[b].changed) <= tick)
+            ++b;
+        if (b == i / BlockSize)
+            return i;
+        return b < _blocks.size() ? b * BlockSize : npos;
+    }
+
+    std::vector<Id> removed_since(uint64_t tick) const {
+        std::vector<Id> ids;
+        for (auto const& [id, t]: _removed)
+            if (t > tick)
+                ids.push_back(id);
+        return ids;
+    }
+
+    // forget the removals at or before `tick`
+    void forget_removed(uint64_t tick) {
+        _removed.erase(std::remove_if(_removed.begin(), _removed.end(), [tick](auto const& r) { return r.second <= tick; }),
+                       _removed.end());
+    }
+
+private:
+    struct Block { uint64_t added = 0, changed = 0; };
+
+    void grow(size_t i) {
+        if (i >= _changed.size()) {
+            _added.resize(i + 1);
+            _changed.resize(i + 1);
+            _blocks.resize(i / BlockSize + 1);
+        }
+    }
+
+    std::vector<uint64_t>                _added   {};
+    std::vector<uint64_t>                _changed {};
+    std::vector<Block>                   _blocks  {};
+    std::vector<std::pair<Id, uint64_t>> _removed {};
+};
+
+// The entity ids that have a component, as a bitset with summary layers: each bit of a layer tells if a
+// word of the layer below is not empty, so a bit of the second layer covers 4096 ids, and one of the
+// third covers 262144. The search for ids that are in several sets (and not in others) skips the
+// regions that are empty in any of the required sets without looking at their words.
+class IdBitset {
+public:
+    static constexpr size_t Layers = 4;
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+    void set(size_t id) {
+        for (size_t l = 0; l < Layers; ++l, id >>= 6) {
+            auto& layer = _layers[l];
+            if ((id >> 6) >= layer.size())
+                layer.resize((id >> 6) + 1, 0);
+            bool was_empty = layer[id >> 6] == 0;
+            layer[id >> 6] |= bit(id);
+            if (!was_empty)
+                break;
+        }
+    }
+
+    void reset(size_t id) {
+        for (size_t l = 0; l < Layers && (id >> 6) < _layers[l].size(); ++l, id >>= 6) {
+            _layers[l][id >> 6] &= ~bit(id);
+            if (_layers[l][id >> 6] != 0)
+                break;
+        }
+    }
+
+    bool test(size_t id) const              { return word(0, id >> 6) & bit(id); }
+    void clear()                            { for (auto& layer: _layers) layer.clear(); }
+
+    // the first id, not lower than `from`, that is in all the `required` sets and in none of the `excluded` sets
+    template <size_t N>
+    static size_t next(std::array<IdBitset const*, N> const& required, size_t n_required,
+                       std::array<IdBitset const*, N> const& excluded, size_t n_excluded, size_t from) {
         // {{{ ...
-        return find_matching_entities_component<T...>(_pool_set);
+        size_t top_words = npos;
+        for (size_t r = 0; r < n_required; ++r)
+            top_words = std::min(top_words, required[r]->_layers[Layers - 1].size());
+
+        size_t l = 0, i = from;   // the bit `i` of the layer `l`
+        while (true) {
+            uint64_t w = ~uint64_t(0);
+            for (size_t r = 0; r < n_required; ++r)
+                w &= required[r]->word(l, i >> 6);
+            if (l == 0)
+                for (size_t e = 0; e < n_excluded; ++e)
+                    w &= ~excluded[e]->word(0, i >> 6);
+            w &= ~uint64_t(0) << (i & 63);
+
+            if (w != 0) {
+                size_t found = (i & ~size_t(63)) | static_cast<size_t>(__builtin_ctzll(w));
+                if (l == 0)
+                    return found;
+                --l;                     // descend to the first id of the word that is not empty
+                i = found << 6;
+            } else if (l + 1 < Layers) {
+                ++l;                     // ascend to the bit of the next word
+                i = (i >> 6) + 1;
+            } else {
+                i = ((i >> 6) + 1) << 6; // the top layer is searched word by word
+                if ((i >> 6) >= top_words)
+                    return npos;
+            }
+        }
         // }}}
     }
 
-    template <typename... T>
-    std::vector<Entity<ECS, Pool>> entities(Pool pool) {
+private:
+    static uint64_t bit(size_t i)           { return uint64_t(1) << (i & 63); }
+
+    uint64_t word(size_t layer, size_t w) const {
+        return w < _layers[layer].size() ? _layers[layer][w] : 0;
+    }
+
+    std::array<std::vector<uint64_t>, Layers> _layers {};
+};
+
+// converts to `C { pars... }`, so that a container can build the component directly in its memory
+template <typename C, typename... P>
+struct BraceInit {
+    std::tuple<P&&...> pars;
+    operator C() && {
+        return std::apply([](auto&& ...p) { return C { std::forward<decltype(p)>(p)... }; }, std::move(pars));
+    }
+};
+
+// Stores the components of one type (in one pool), sorted by entity id. The ids
+// are kept in their own column, so the components are stored at their natural
+// size, and searching for an id doesn't touch the component data. This is the
+// `Storage::Dense` storage, used by most components.
+template <typename Id, typename C, Storage Kind>
+class ComponentStorage : public IdColumn<Id> {
+    using IdColumn<Id>::_ids;
+    using IdColumn<Id>::_split;
+public:
+    C&       at(size_t i)                   { return _data[i]; }
+    C const& at(size_t i) const             { return _data[i]; }
+
+    // constructs the component in place, as `C { pars... }`, or reuses a recycled component
+    template <typename... P>
+    C& emplace(size_t i, Id id, P&& ...pars) {
         // {{{ ...
-        return find_matching_entities_component<T...>(std::vector<Pool> { pool });
+        if constexpr (can_recycle<C, std::tuple<P...>>::value) {
+            if (!_free.empty()) {
+                C c = std::move(_free.back());
+                _free.pop_back();
+                recycle_traits<C>::reset(c, std::forward<P>(pars)...);
+                return insert(i, id, std::move(c));
+            }
+        }
+        return insert(i, id, BraceInit<C, P...> { std::forward_as_tuple(std::forward<P>(pars)...) });
         // }}}
     }
 
-    std::vector<ConstEntity<ECS, Pool>> entities() const {
+    void erase(size_t i) {
+        recycle(i);
+        drop(i);
+    }
+
+    void clear() {
         // {{{ ...
-        return find_matching_entities(_pool_set);
+        if constexpr (recycle_traits<C>::enabled)
+            for (size_t i = 0; i < _data.size(); ++i)
+                recycle(i);
+        _ids.clear();
+        _data.clear();
+        _split = 0;
+        compact_arena();
         // }}}
     }
 
-    std::vector<ConstEntity<ECS, Pool>> entities(Pool pool) const {
+    // moves the component in position `i` to another storage
+    void move_to(size_t i, ComponentStorage& dest) {
         // {{{ ...
-        return find_matching_entities(std::vector<Pool> { pool });
+        size_t j = dest.lower_bound(_ids[i]);
+        dest._ids.insert(dest._ids.begin() + static_cast<std::ptrdiff_t>(j), _ids[i]);
+        dest.attach(*dest._data.insert(dest._data.begin() + static_cast<std::ptrdiff_t>(j), std::move(_data[i])));
+        drop(i);   // the moved-from component is not recycled
         // }}}
     }
 
-    template <typename... T>
-    std::vector<ConstEntity<ECS, Pool>> entities() const {
+    // moves the components of the entities in `ids` (which must be sorted) to another storage
+    void move_to(std::vector<Id> const& ids, ComponentStorage& dest) {
         // {{{ ...
-        return find_matching_entities_component<T...>(_pool_set);
+        // split this storage in a single pass between the components that move and the ones that stay
+        // (the moving entities must have already left the group)
+        if (!this->contains_any(ids, _split))
+            return;
+        ComponentStorage moving, staying;
+        auto id_it = ids.begin();
+        for (size_t i = _split; i < _ids.size(); ++i) {
+            while (id_it != ids.end() && *id_it < _ids[i])
+                ++id_it;
+            ComponentStorage& to = (id_it != ids.end() && *id_it == _ids[i]) ? moving : staying;
+            to._ids.push_back(_ids[i]);
+            to._data.push_back(std::move(_data[i]));
+        }
+        for (size_t i = 0; i < moving._data.size(); ++i)
+            dest.attach(moving._data[i]);
+        _ids.erase(_ids.begin() + static_cast<std::ptrdiff_t>(_split), _ids.end());
+        _data.erase(_data.begin() + static_cast<std::ptrdiff_t>(_split), _data.end());
+        _ids.insert(_ids.end(), staying._ids.begin(), staying._ids.end());
+        _data.insert(_data.end(), std::make_move_iterator(staying._data.begin()), std::make_move_iterator(staying._data.end()));
+        compact_arena();
+        dest.merge(std::move(moving));
         // }}}
     }
 
-    template <typename... T>
-    std::vector<ConstEntity<ECS, Pool>> entities(Pool pool) const {
+    // moves the component in position `i` (that is not in the group) to the group
+    void enter_group(size_t i) {
         // {{{ ...
-        return find_matching_entities_component<T...>(std::vector<Pool> { pool });
+        auto j = std::lower_bound(_ids.begin(), _ids.begin() + static_cast<std::ptrdiff_t>(_split), _ids[i]) - _ids.begin();
+        std::rotate(_ids.begin() + j, _ids.begin() + static_cast<std::ptrdiff_t>(i), _ids.begin() + static_cast<std::ptrdiff_t>(i) + 1);
+        std::rotate(_data.begin() + j, _data.begin() + static_cast<std::ptrdiff_t>(i), _data.begin() + static_cast<std::ptrdiff_t>(i) + 1);
+        ++_split;
         // }}}
     }
 
-    //
-    // globals
-    //
+    // moves the component in position `i` (that is in the group) out of the group
+    void leave_group(size_t i) {
+        // {{{ ...
+        auto j = std::lower_bound(_ids.begin() + static_cast<std::ptrdiff_t>(_split), _ids.end(), _ids[i]) - _ids.begin();
+        std::rotate(_ids.begin() + static_cast<std::ptrdiff_t>(i), _ids.begin() + static_cast<std::ptrdiff_t>(i) + 1, _ids.begin() + j);
+        std::rotate(_data.begin() + static_cast<std::ptrdiff_t>(i), _data.begin() + static_cast<std::ptrdiff_t>(i) + 1, _data.begin() + j);
+        --_split;
+        // }}}
+    }
 
-    Global& operator()()                        { return _global; }
-    Global const& operator()() const            { return _global; }
+private:
+    template <typename V>
+    C& insert(size_t i, Id id, V&& value) {
+        if (i == _ids.size()) {   // most common case: the entity is the newest one
+            _ids.push_back(id);
+            return attach(_data.emplace_back(std::forward<V>(value)));
+        }
+        _ids.insert(_ids.begin() + static_cast<std::ptrdiff_t>(i), id);
+        return attach(*_data.emplace(_data.begin() + static_cast<std::ptrdiff_t>(i), std::forward<V>(value)));
+    }
 
-    //
-    // messages
-    //
+    // buffers use the arena of the pool where they are stored
+    C& attach(C& c) {
+        if constexpr (is_buffer<C>::value)
+            c.attach(&_arena);
+        return c;
+    }
 
-    void add_message(Message&& e) const {
+    // removes the component in position `i`, without recycling it
+    void drop(size_t i) {
         // {{{ ...
-        if (_running_mt)
-            _messages.push_sync(std::move(e), _current_system);
-        else
-            _messages.push_nosync(std::move(e), _current_system);
+        _ids.erase(_ids.begin() + static_cast<std::ptrdiff_t>(i));
+        _data.erase(_data.begin() + static_cast<std::ptrdiff_t>(i));
+        _split -= (i < _split) ? 1 : 0;
+        compact_arena();
         // }}}
     }
 
-    template<typename T>
-    std::vector<T> messages() const {
+    // keeps the component in position `i` in the free list, if recycling is enabled and the list isn't full
+    void recycle(size_t i) {
+        if constexpr (recycle_traits<C>::enabled)
+            if (_free.size() < recycle_max_free<C>::value)
+                _free.push_back(std::move(_data[i]));
+    }
+
+    // when more than half of the arena is unused, copy the buffers to a new arena
+    void compact_arena() {
         // {{{ ...
-        std::vector<T> r;
-        for (std::pair<Message, SystemPtr> ev : _messages.underlying_vector())
-            if (std::holds_alternative<T>(ev.first))
-                r.push_back(std::get<T>(ev.first));
-        return r;
+        if constexpr (is_buffer<C>::value) {
+            if (_arena.garbage() == 0 || _arena.garbage() * 2 < _arena.size())
+                return;
+            std::vector<typename C::buffer_value_type> data;
+            data.reserve(_arena.size() - _arena.garbage());
+            for (size_t i = 0; i < _data.size(); ++i)
+                _data[i].compact_to(data);
+            _arena.reset(std::move(data));
+        }
         // }}}
     }
 
-    template<typename T>
-    std::vector<T> pop_messages() const {
+    // merges a sorted storage into this one (outside of the group)
+    void merge(ComponentStorage&& other) {
         // {{{ ...
-        std::vector<T> r;
-        for (std::pair<Message, SystemPtr> ev : _messages.underlying_vector())
-            if (std::holds_alternative<T>(ev.first))
-                r.push_back(std::get<T>(ev.first));
-        _messages.template clear_with_type<T>();
-        return r;
-    }
+        if (_ids.size() == _split || other._ids.front() > _ids.back()) {   // most common case: the new ids go to the end
+            _ids.insert(_ids.end(), other._ids.begin(), other._ids.end());
+            _data.insert(_data.end(), std::make_move_iterator(other._data.begin()), std::make_move_iterator(other._data.end()));
+            return;
+        }
 
-    void clear_messages()                       { _messages.clear(); }
+        ComponentStorage merged;
+        merged._ids.reserve(_ids.size() + other._ids.size());
+        merged._data.reserve(_ids.size() + other._ids.size());
+        for (size_t k = 0; k < _split; ++k) {
+            merged._ids.push_back(_ids[k]);
+            merged._data.push_back(std::move(_data[k]));
+        }
+        size_t i = _split, j = 0;
+        while (i < _ids.size() || j < other._ids.size()) {
+            bool mine = j == other._ids.size() || (i < _ids.size() && _ids[i] < other._ids[j]);
+            ComponentStorage& from = mine ? *this : other;
+            size_t& k = mine ? i : j;
+            merged._ids.push_back(from._ids[k]);
+            merged._data.push_back(std::move(from._data[k]));
+            ++k;
+        }
+        _ids = std::move(merged._ids);
+        _data = std::move(merged._data);
+        // }}}
+    }
 
-    //
-    // systems
-    //
+    using Data = std::conditional_t<is_trivially_relocatable<C>::value, RelocatableVector<C>, std::vector<C>>;
 
-    void start_frame()                          { _timer.start_frame(); }
-    void reset_timer()                          { _timer.reset(); }
+    using Arena = std::conditional_t<is_buffer<C>::value, BufferArena<typename is_buffer<C>::value_type>, std::nullptr_t>;
 
-    std::vector<SystemTime> timer_st() const { return _timer.timer(false); }
-    std::vector<SystemTime> timer_mt() const { return _timer.timer(true); }
+    Arena           _arena {};  // used by `Buffer` components, declared first so it's destroyed last
+    Data            _data  {};
+    std::vector<C>  _free  {};   // recycled components, if enabled
+};
 
-    // {{{ auxiliary methods
-private:
-    using Time = std::chrono::time_point<std::chrono::high_resolution_clock>;
+// The values of a `Shared` component, each one stored once, with the number of components that use it.
+template <typename C>
+class SharedTable {
+public:
+    C const& at(uint32_t index) const       { return *_entries[index].value; }
 
-    static Time now() { return std::chrono::high_resolution_clock::now(); }
+    // returns the index of an equal value, or stores a new one
+    template <typename V>
+    uint32_t acquire(V&& value) {
+        // {{{ ...
+        size_t hash = hash_of(value);
+        auto [first, last] = _by_hash.equal_range(hash);
+        for (auto it = first; it != last; ++it) {
+            if (*_entries[it->second].value == value) {
+                ++_entries[it->second].refs;
+                return it->second;
+            }
+        }
 
-    void add_time(std::string const& name, Time start, bool mt) const {
-        _timer.add_time(name, std::chrono::duration_cast<std::chrono::microseconds>(now() - start), mt);
+        uint32_t index;
+        if (_free.empty()) {
+            index = static_cast<uint32_t>(_entries.size());
+            _entries.emplace_back();
+        } else {
+            index = _free.back();
+            _free.pop_back();
+        }
+        _entries[index].value.emplace(std::forward<V>(value));
+        _entries[index].refs = 1;
+        _by_hash.emplace(hash, index);
+        return index;
+        // }}}
     }
 
-    void update_current_system(std::string const& system_name) const {
-        auto it = _system_idx.find(system_name);
-        if (it == _system_idx.end()) {
-            if (_system_idx.empty())
-                _current_system = 0;
-            else
-                _current_system = std::max_element(_system_idx.begin(), _system_idx.end(),
-                    [](auto const& a, auto const& b) { return a.second < b.second; })->second + 1;
-            _system_idx[system_name] = _current_system;
-        } else {  // more likely branch
-            _current_system = it->second;
+    void release(uint32_t index) {
+        // {{{ ...
+        Entry& entry = _entries[index];
+        if (--entry.refs > 0)
+            return;
+        auto [first, last] = _by_hash.equal_range(hash_of(*entry.value));
+        for (auto it = first; it != last; ++it) {
+            if (it->second == index) {
+                _by_hash.erase(it);
+                break;
+            }
         }
+        entry.value.reset();
+        _free.push_back(index);
+        // }}}
     }
-    // }}}
 
+    void clear() {
+        _entries.clear();
+        _free.clear();
+        _by_hash.clear();
+    }
+
+private:
+    template <typename T, typename = void>
+    struct is_hashable : std::false_type {};
+
+    template <typename T>
+    struct is_hashable<T, std::void_t<decltype(std::hash<T>{}(std::declval<T const&>()))>> : std::true_type {};
+
+    // values without a `std::hash` are compared one by one
+    static size_t hash_of([[maybe_unused]] C const& value) {
+        if constexpr (is_hashable<C>::value)
+            return std::hash<C>{}(value);
+        else
+            return 0;
+    }
+
+    struct Entry {
+        std::optional<C> value {};
+        uint32_t         refs  = 0;
+    };
+
+    std::vector<Entry>                           _entries {};
+    std::vector<uint32_t>                        _free    {};
+    std::unordered_multimap<size_t, uint32_t>    _by_hash {};
+};
+
+// Shared components: the storage keeps, for each entity, the index of its value in the table.
+template <typename Id, typename C>
+class ComponentStorage<Id, Shared<C>, Storage::Dense> {
+    using Indexes = ComponentStorage<Id, uint32_t>;
 public:
-    template<typename F, typename... P>
-    void run_st(std::string const& name, F f, P&& ...pars) const {
-        // {{{ ...
-        auto start = now();
-        update_current_system(name);
-        _messages.clear_with_system(_current_system);
-        f(*this, pars...);
-        add_time(name, start, false);
-        // }}}
+    static constexpr size_t npos = Indexes::npos;
+
+    size_t size() const                     { return _indexes.size(); }
+    bool   empty() const                    { return _indexes.empty(); }
+
+    std::vector<Id> const& ids() const      { return _indexes.ids(); }
+    C const& at(size_t i) const             { return _table.at(_indexes.at(i)); }
+
+    size_t lower_bound(Id id) const         { return _indexes.lower_bound(id); }
+    size_t find(Id id) const                { return _indexes.find(id); }
+    size_t group_size() const               { return 0; }
+
+    template <typename... P>
+    C const& emplace(size_t i, Id id, P&& ...pars) {
+        uint32_t index = _table.acquire(C { std::forward<P>(pars)... });
+        _indexes.emplace(i, id, index);
+        return _table.at(index);
     }
 
-    template<typename O, typename F, typename... P, class = typename std::enable_if<std::is_class<O>::value>::type>
-    void run_st(std::string const& name, O& obj, F f, P&& ...pars) const {
-        // {{{ ...
-        auto start = now();
-        update_current_system(name);
-        _messages.clear_with_system(_current_system);
-        (obj.*f)(*this, pars...);
-        add_time(name, start, false);
-        // }}}
+    void erase(size_t i) {
+        _table.release(_indexes.at(i));
+        _indexes.erase(i);
     }
 
-    template<typename F, typename... P>
-    void run_mutable(std::string const& name, F f, P&& ...pars) {
+    void clear() {
+        _indexes.clear();
+        _table.clear();
+    }
+
+    void move_to(size_t i, ComponentStorage& dest) {
+        Id id = ids()[i];
+        dest._indexes.emplace(dest.lower_bound(id), id, dest._table.acquire(at(i)));
+        erase(i);
+    }
+
+    void move_to(std::vector<Id> const& ids, ComponentStorage& dest) {
         // {{{ ...
-        auto start = now();
-        update_current_system(name);
-        _messages.clear_with_system(_current_system);
-        f(*this, pars...);
-        add_time(name, start, false);
+        // point the indexes to the table of the destination, and then move them
+        for (Id id : ids) {
+            size_t i = find(id);
+            if (i != npos) {
+                uint32_t index = dest._table.acquire(at(i));
+                _table.release(_indexes.at(i));
+                _indexes.at(i) = index;
+            }
+        }
+        _indexes.move_to(ids, dest._indexes);
         // }}}
     }
 
-    template<typename O, typename F, typename... P, class = typename std::enable_if<std::is_class<O>::value>::type>
-    void run_mutable(std::string const& name, O& obj, F f, P&& ...pars) {
+private:
+    Indexes        _indexes {};
+    SharedTable<C> _table   {};
+};
+
+// Split components: one id column, shared by a column of hot parts and a column of cold parts.
+template <typename Id, typename Hot, typename Cold>
+class ComponentStorage<Id, Split<Hot, Cold>, Storage::Dense> : public IdColumn<Id> {
+    using IdColumn<Id>::_ids;
+public:
+    SplitRef<Hot, Cold> at(size_t i)                    { return { &_hot[i], &_cold[i] }; }
+    SplitRef<Hot const, Cold const> at(size_t i) const  { return { &_hot[i], &_cold[i] }; }
+
+    // the parameters are the hot part and the cold part (both optional)
+    template <typename... P>
+    SplitRef<Hot, Cold> emplace(size_t i, Id id, P&& ...pars) {
         // {{{ ...
-        auto start = now();
-        update_current_system(name);
-        _messages.clear_with_system(_current_system);
-        (obj.*f)(*this, pars...);
-        add_time(name, start, false);
+        static_assert(sizeof...(P) <= 2, "A split component is created from its hot and cold parts.");
+        std::tuple<P&&...> parts { std::forward<P>(pars)... };
+        return insert(i, id, part<Hot, 0>(std::move(parts)), part<Cold, 1>(std::move(parts)));
         // }}}
     }
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wparentheses"
+    void erase(size_t i) {
+        _ids.erase(_ids.begin() + static_cast<std::ptrdiff_t>(i));
+        _hot.erase(_hot.begin() + static_cast<std::ptrdiff_t>(i));
+        _cold.erase(_cold.begin() + static_cast<std::ptrdiff_t>(i));
+    }
 
-    template<typename F, typename... P>
-    void run_mt(std::string const& name, F f, P&& ...pars) const {
+    void clear() {
+        _ids.clear();
+        _hot.clear();
+        _cold.clear();
+    }
+
+    void move_to(size_t i, ComponentStorage& dest) {
+        dest.insert(dest.lower_bound(_ids[i]), _ids[i], std::move(_hot[i]), std::move(_cold[i]));
+        erase(i);
+    }
+
+    void move_to(std::vector<Id> const& ids, ComponentStorage& dest) {
         // {{{ ...
-        static_assert(!(((std::is_reference_v<P> && !std::is_const_v<P>) || ...)),
-                      "Don't use non-const references in multithreaded code. Use pointers instead.");
-        if (_threading == Threading::Single) {
-            run_st(name, f, pars...);
-        } else {
-            _threads.emplace_back([this](std::string name, MyECS const& ecs, auto f, auto... pars) {
-                auto start = now();
-                update_current_system(name);
-                _messages.clear_with_system(_current_system);
-                f(ecs, pars...);
-                ecs.add_time(name, start, true);
-            }, name, std::ref(*this), f, pars...);
+        if (!this->contains_any(ids))
+            return;
+        ComponentStorage moving, staying;
+        auto id_it = ids.begin();
+        for (size_t i = 0; i < _ids.size(); ++i) {
+            while (id_it != ids.end() && *id_it < _ids[i])
+                ++id_it;
+            bool moves = id_it != ids.end() && *id_it == _ids[i];
+            (moves ? moving : staying).push_back(_ids[i], std::move(_hot[i]), std::move(_cold[i]));
+        }
+        *this = std::move(staying);
+
+        if (dest.empty() || moving._ids.front() > dest._ids.back()) {   // most common case: the new ids go to the end
+            for (size_t i = 0; i < moving.size(); ++i)
+                dest.push_back(moving._ids[i], std::move(moving._hot[i]), std::move(moving._cold[i]));
+            return;
+        }
+        ComponentStorage merged;
+        size_t i = 0, j = 0;
+        while (i < dest.size() || j < moving.size()) {
+            bool mine = j == moving.size() || (i < dest.size() && dest._ids[i] < moving._ids[j]);
+            ComponentStorage& from = mine ? dest : moving;
+            size_t& k = mine ? i : j;
+            merged.push_back(from._ids[k], std::move(from._hot[k]), std::move(from._cold[k]));
+            ++k;
         }
+        dest = std::move(merged);
         // }}}
     }
 
-    template<typename O, typename F, typename... P, class = typename std::enable_if<std::is_class<O>::value>::type>
-    void run_mt(std::string const& name, O& obj, F f, P&& ...pars) const {
-        // {{{ ...
-        static_assert(!(((std::is_reference_v<P> && !std::is_const_v<P>) || ...)),
-                      "Don't use non-const references in multithreaded code. Use pointers instead.");
-        if (_threading == Threading::Single) {
-            run_st(name, obj, f, pars...);
-        } else {
-            _threads.emplace_back([this](auto* obj, std::string name, MyECS const& ecs, auto f, auto&... pars) {
-                auto start = now();
-                update_current_system(name);
-                _messages.clear_with_system(_current_system);
-                std::invoke(f, obj, ecs, pars...);
-                ecs.add_time(name, start, true);
-            }, &obj, name, std::ref(*this), f, pars...);
-        }
+private:
+    template <typename T, size_t K, typename Parts>
+    static T part(Parts&& parts) {
+        if constexpr (K < std::tuple_size_v<std::decay_t<Parts>>)
+            return T { std::get<K>(std::move(parts)) };
+        else
+            return T {};
+    }
+
+    SplitRef<Hot, Cold> insert(size_t i, Id id, Hot&& hot, Cold&& cold) {
+        auto pos = static_cast<std::ptrdiff_t>(i);
+        _ids.insert(_ids.begin() + pos, id);
+        _hot.insert(_hot.begin() + pos, std::move(hot));
+        _cold.insert(_cold.begin() + pos, std::move(cold));
+        return at(i);
+    }
+
+    void push_back(Id id, Hot&& hot, Cold&& cold) {
+        _ids.push_back(id);
+        _hot.push_back(std::move(hot));
+        _cold.push_back(std::move(cold));
+    }
+
+    std::vector<Hot>  _hot  {};
+    std::vector<Cold> _cold {};
+};
+
+// Tag components: only the ids are stored.
+template <typename Id, typename C>
+class ComponentStorage<Id, C, Storage::Tag> : public IdColumn<Id> {
+    using IdColumn<Id>::_ids;
+public:
+    C&       at(size_t)                     { return _tag; }
+    C const& at(size_t) const               { return _tag; }
+
+    template <typename... P>
+    C& emplace(size_t i, Id id, [[maybe_unused]] P&& ...pars) {
+        static_assert(sizeof...(P) == 0, "Tag components are created without parameters.");
+        _ids.insert(_ids.begin() + static_cast<std::ptrdiff_t>(i), id);
+        return _tag;
+    }
+
+    void erase(size_t i)                    { _ids.erase(_ids.begin() + static_cast<std::ptrdiff_t>(i)); }
+    void clear()                            { _ids.clear(); }
+
+    void move_to(size_t i, ComponentStorage& dest) {
+        dest.emplace(dest.lower_bound(_ids[i]), _ids[i]);
+        erase(i);
+    }
+
+    void move_to(std::vector<Id> const& ids, ComponentStorage& dest) {
+        dest.merge_ids(this->take_ids(ids));
+    }
+
+private:
+    C _tag {};
+};
+
+// Sparse components: the ids are sorted, and the components are kept in a hash table.
+template <typename Id, typename C>
+class ComponentStorage<Id, C, Storage::Sparse> : public IdColumn<Id> {
+    using IdColumn<Id>::_ids;
+public:
+    C&       at(size_t i)                   { return _data.find(_ids[i])->second; }
+    C const& at(size_t i) const             { return _data.find(_ids[i])->second; }
+
+    template <typename... P>
+    C& emplace(size_t i, Id id, P&& ...pars) {
+        C& c = _data.try_emplace(id, BraceInit<C, P...> { std::forward_as_tuple(std::forward<P>(pars)...) }).first->second;
+        _ids.insert(_ids.begin() + static_cast<std::ptrdiff_t>(i), id);
+        return c;
+    }
+
+    void erase(size_t i) {
+        _data.erase(_ids[i]);
+        _ids.erase(_ids.begin() + static_cast<std::ptrdiff_t>(i));
+    }
+
+    void clear() {
+        _ids.clear();
+        _data.clear();
+    }
+
+    // the nodes of the hash table are moved to the other storage, so the components themselves are not moved
+    void move_to(size_t i, ComponentStorage& dest) {
+        Id id = _ids[i];
+        dest._data.insert(_data.extract(id));
+        dest._ids.insert(dest._ids.begin() + static_cast<std::ptrdiff_t>(dest.lower_bound(id)), id);
+        erase_id(i);
+    }
+
+    void move_to(std::vector<Id> const& ids, ComponentStorage& dest) {
+        std::vector<Id> taken = this->take_ids(ids);
+        for (Id id : taken)
+            dest._data.insert(_data.extract(id));
+        dest.merge_ids(taken);
+    }
+
+private:
+    void erase_id(size_t i)                 { _ids.erase(_ids.begin() + static_cast<std::ptrdiff_t>(i)); }
+
+    std::unordered_map<Id, C> _data {};
+};
+
+// Stable components: the storage keeps pointers to components allocated separately.
+template <typename Id, typename C>
+class ComponentStorage<Id, C, Storage::Stable> {
+    using Pointers = ComponentStorage<Id, std::unique_ptr<C>, Storage::Dense>;
+public:
+    static constexpr size_t npos = Pointers::npos;
+
+    size_t size() const                     { return _pointers.size(); }
+    bool   empty() const                    { return _pointers.empty(); }
+
+    std::vector<Id> const& ids() const      { return _pointers.ids(); }
+    C&       at(size_t i)                   { return *_pointers.at(i); }
+    C const& at(size_t i) const             { return *_pointers.at(i); }
+
+    size_t lower_bound(Id id) const         { return _pointers.lower_bound(id); }
+    size_t find(Id id) const                { return _pointers.find(id); }
+    size_t group_size() const               { return 0; }
+
+    template <typename... P>
+    C& emplace(size_t i, Id id, P&& ...pars) {
+        return *_pointers.emplace(i, id, std::unique_ptr<C>(new C { std::forward<P>(pars)... }));
+    }
+
+    void erase(size_t i)                    { _pointers.erase(i); }
+    void clear()                            { _pointers.clear(); }
+
+    void move_to(size_t i, ComponentStorage& dest)                       { _pointers.move_to(i, dest._pointers); }
+    void move_to(std::vector<Id> const& ids, ComponentStorage& dest)     { _pointers.move_to(ids, dest._pointers); }
+
+private:
+    Pointers _pointers {};
+};
+
+// }}}
+
+// {{{ synchronized queue
+
+template <typename T>
+class SyncQueue {
+public:
+    void push_sync(const T& item, SystemPtr const& current_system)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back({ item, current_system });
+    }
+
+    void push_sync(T&& item, SystemPtr const& current_system)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back({ std::move(item), current_system });
+    }
+
+    void push_nosync(const T& item, SystemPtr const& current_system)
+    {
+        queue_.push_back({ item, current_system });
+    }
+
+    void push_nosync(T&& item, SystemPtr const& current_system)
+    {
+        queue_.push_back({ std::move(item), current_system });
+    }
+
+    std::vector<std::pair<T, SystemPtr>> const& underlying_vector() const {
+        return queue_;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.clear();
+    }
+
+    void clear_with_system(SystemPtr const& system_ptr) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.erase(std::remove_if(queue_.begin(), queue_.end(),
+                                [&system_ptr](std::pair<T, SystemPtr> const& t) { return t.second == system_ptr; }),
+                     queue_.end());
+    }
+
+    template<typename U>
+    void clear_with_type() {
+        queue_.erase(std::remove_if(queue_.begin(), queue_.end(),
+                     [](std::pair<T, SystemPtr> const& t) { return std::holds_alternative<U>(t.first); }),
+                     queue_.end());
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return queue_.size();
+    }
+
+private:
+    std::vector<std::pair<T, SystemPtr>> queue_ {};
+    mutable std::mutex mutex_ {};
+};
+
+// }}}
+
+// {{{ timer
+
+struct SystemTime {
+    std::string               name;
+    std::chrono::microseconds us;
+};
+
+class Timer {
+public:
+    void start_frame() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++_iterations;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        _timer_mt.clear();
+        _timer_st.clear();
+        _iterations = 0;
+    }
+
+    void add_time(std::string const& name, std::chrono::microseconds us, bool mt) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& timer = mt ? _timer_mt : _timer_st;
+            auto it = std::find_if(timer.begin(), timer.end(),
+                                   [&name](SystemTime const& s) { return s.name == name; });
+            if (it == timer.end())
+                timer.push_back({ name, us });
+            else
+                it->us += us;
+        }
+        if (mt)
+            add_time("multithreaded", us, false);
+    }
+
+    [[nodiscard]] std::vector<SystemTime> timer(bool mt) const {
+        auto& timer = (mt ? _timer_mt : _timer_st);
+        std::vector<SystemTime> t(timer.begin(), timer.end());
+        for (auto& [_, us]: t)
+            us /= _iterations;
+        return t;
+    }
+
+private:
+    std::vector<SystemTime> _timer_mt {};
+    std::vector<SystemTime> _timer_st {};
+    size_t _iterations = 0;
+    std::mutex mutex_ {};
+};
+
+// }}}
+
+template <typename IdType, typename Global, typename Message, typename PoolDef, typename... Components>
+class BasicECS {
+    using MyECS = BasicECS<IdType, Global, Message, PoolDef, Components...>;
+    using ECS = MyECS;
+    using PoolTraits = pool_traits<PoolDef>;
+    using Pool = typename PoolTraits::type;
+
+public:
+    using Id = IdType;
+    using EntityType = Entity<MyECS, Pool>;
+    using ConstEntityType = ConstEntity<MyECS, Pool>;
+
+    static const char* version() { return ECS_VERSION; }
+
+    template <typename... P>
+    explicit BasicECS(P&& ...pars)
+            : _global(Global { pars... }) {}
+
+    ~BasicECS() { join(); }
+
+    void set_threading(Threading t)         { _threading = t; }
+
+    //
+    // entities
+    //
+
+    Entity<MyECS, Pool> add() {
+        // {{{ ...
+        return add_entity(DefaultPool, DefaultPoolIndex);
+        // }}}
+    }
+
+    Entity<MyECS, Pool> add(Pool pool) {
+        // {{{ ...
+        return add_entity(pool, register_pool(pool));
+        // }}}
+    }
+
+    Entity<MyECS, Pool> get(Id id) {
+        // {{{
+        auto it = _entities.find(id);
+        if (it == _entities.end())
+            throw ECSError("Id " + std::to_string(id) + " not found.");
+        return Entity<MyECS, Pool>(id, _slots[it->second].pool, this);
+        // }}}
+    }
+
+    template <typename Component>
+    ComponentRef<Component> get(Id id) {
+        // {{{
+        return component<Component>(id, pool_of(id));
+        // }}}
+    }
+
+    template<typename Component>
+    ComponentPtr<Component> get_ptr(Id id) {
+        // {{{
+        return component_ptr<Component>(id, pool_of(id));
+        // }}}
+    }
+
+    template<typename Component>
+    ComponentConstPtr<Component> get_ptr(Id id) const {
+        // {{{
+        return component_ptr<Component>(id, pool_of(id));
+        // }}}
+    }
+
+    template <typename Component>
+    bool has(Id id) const {
+        // {{{
+        return has_component<Component>(id, pool_of(id));
+        // }}}
+    }
+
+    ConstEntity<MyECS, Pool> get(Id id) const {
+        // {{{
+        auto it = _entities.find(id);
+        if (it == _entities.end())
+            throw ECSError("Id " + std::to_string(id) + " not found.");
+        return ConstEntity<MyECS, Pool>(id, _slots[it->second].pool, this);
+        // }}}
+    }
+
+    template <typename Component>
+    ComponentConstRef<Component> get(Id id) const {
+        // {{{
+        return component<Component>(id, pool_of(id));
+        // }}}
+    }
+
+    bool exists(Id id) const {
+        // {{{
+        auto it = _entities.find(id);
+        return it != _entities.end();
+        // }}}
+    }
+
+    //
+    // entity handles
+    //
+
+    EntityHandle handle(Id id) const {
+        // {{{ ...
+        auto it = _entities.find(id);
+        if (it == _entities.end())
+            throw ECSError("Id " + std::to_string(id) + " not found.");
+        return { it->second, _slots[it->second].generation };
+        // }}}
+    }
+
+    bool valid(EntityHandle h) const {
+        // {{{ ...
+        return h.index < _slots.size() && _slots[h.index].generation == h.generation && _slots[h.index].alive;
+        // }}}
+    }
+
+    Entity<MyECS, Pool> get(EntityHandle h) {
+        // {{{ ...
+        EntitySlot const& slot = handle_slot(h);
+        return Entity<MyECS, Pool>(slot.id, slot.pool, this);
+        // }}}
+    }
+
+    ConstEntity<MyECS, Pool> get(EntityHandle h) const {
+        // {{{ ...
+        EntitySlot const& slot = handle_slot(h);
+        return ConstEntity<MyECS, Pool>(slot.id, slot.pool, this);
+        // }}}
+    }
+
+    template <typename Component>
+    ComponentRef<Component> get(EntityHandle h) {
+        // {{{ ...
+        EntitySlot const& slot = handle_slot(h);
+        return component<Component>(slot.id, slot.pool);
+        // }}}
+    }
+
+    template <typename Component>
+    ComponentConstRef<Component> get(EntityHandle h) const {
+        // {{{ ...
+        EntitySlot const& slot = handle_slot(h);
+        return component<Component>(slot.id, slot.pool);
+        // }}}
+    }
+
+    template <typename Component>
+    ComponentPtr<Component> get_ptr(EntityHandle h) {
+        // {{{ ...
+        EntitySlot const& slot = handle_slot(h);
+        return component_ptr<Component>(slot.id, slot.pool);
+        // }}}
+    }
+
+    template <typename Component>
+    ComponentConstPtr<Component> get_ptr(EntityHandle h) const {
+        // {{{ ...
+        EntitySlot const& slot = handle_slot(h);
+        return component_ptr<Component>(slot.id, slot.pool);
+        // }}}
+    }
+
+    template <typename Component>
+    bool has(EntityHandle h) const {
+        // {{{ ...
+        EntitySlot const& slot = handle_slot(h);
+        return has_component<Component>(slot.id, slot.pool);
+        // }}}
+    }
+
+    Entity<MyECS, Pool> move_to_pool(Entity<MyECS, Pool> const& entity, Pool pool) {
+        // {{{ ...
+        static_assert(!PoolTraits::pool_in_id, "Entities can't change pool when the pool is encoded in the id.");
+        auto it = _entities.find(entity.id);
+        if (it == _entities.end())
+            throw ECSError("Id " + std::to_string(entity.id) + " not found.");
+        Pool from = _slots[it->second].pool;
+        if (from != pool) {
+            size_t to = register_pool(pool);
+            size_t src = pool_index(from);
+            (check_move<Components>(entity.id, src, to), ...);
+            leave_groups(entity.id, src);
+            (move_component<Components>(entity.id, src, to), ...);
+            enter_groups(entity.id, to);
+            _pools[src].entities.erase(entity.id);
+            _pools[to].entities.insert(entity.id);
+            touch_entities(src);
+            touch_entities(to);
+            _slots[it->second].pool = pool;
+        }
+        return Entity<MyECS, Pool>(entity.id, pool, this);
+        // }}}
+    }
+
+    template <typename Entities>
+    std::vector<Entity<MyECS, Pool>> move_many(Entities const& entities, Pool pool) {
+        // {{{ ...
+        static_assert(!PoolTraits::pool_in_id, "Entities can't change pool when the pool is encoded in the id.");
+        size_t to = register_pool(pool);
+
+        // group the ids by their current pool, so each component vector is partitioned only once
+        std::map<size_t, std::vector<Id>> ids_by_pool;
+        for (auto const& entity : entities) {
+            auto it = _entities.find(entity.id);
+            if (it == _entities.end())
+                throw ECSError("Id " + std::to_string(entity.id) + " not found.");
+            if (_slots[it->second].pool != pool)
+                ids_by_pool[pool_index(_slots[it->second].pool)].push_back(entity.id);
+        }
+
+        for (auto& [src, ids] : ids_by_pool) {
+            std::sort(ids.begin(), ids.end());
+            ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+            for (Id id : ids)
+                (check_move<Components>(id, src, to), ...);
+        }
+
+        std::vector<Entity<MyECS, Pool>> moved;
+        moved.reserve(entities.size());
+        for (auto const& [src, ids] : ids_by_pool) {
+            for (Id id : ids)
+                leave_groups(id, src);
+            (move_components<Components>(ids, src, to), ...);
+            touch_entities(src);
+            touch_entities(to);
+            for (Id id : ids) {
+                enter_groups(id, to);
+                _slots[_entities.at(id)].pool = pool;
+            }
+            _pools[src].entities.erase(ids);
+            _pools[to].entities.insert(ids);
+        }
+        for (auto const& entity : entities)
+            moved.emplace_back(entity.id, pool, this);
+        return moved;
+        // }}}
+    }
+
+    void remove(Entity<MyECS, Pool> const& entity) {
+        // {{{ ...
+        auto it = _entities.find(entity.id);
+        if (it == _entities.end())
+            return;
+        size_t idx = pool_index(_slots[it->second].pool);
+        (erase_component<Components>(entity.id, idx), ...);
+        _pools[idx].entities.erase(entity.id);
+        touch_entities(idx);
+        release_slot(it->second);
+        _entities.erase(it);
+        // }}}
+    }
+
+    void clear_pool(Pool pool) {
+        // {{{ ...
+        size_t idx = checked_pool_index(pool);
+        if (idx == NoPoolIndex)
+            return;
+        PoolData& data = _pools[idx];
+        (clearing_components<Components>(idx), ...);
+
+        // remove the ids from the global directory
+        if (data.entities.size() == _entities.size()) {
+            for (auto const& [_, slot] : _entities)
+                release_slot(slot);
+            _entities.clear();
+        } else {
+            for (Id id : data.entities) {
+                auto it = _entities.find(id);
+                release_slot(it->second);
+                _entities.erase(it);
+            }
+        }
+
+        // clear the pool, keeping the allocated memory for reuse
+        data.entities.clear();
+        ((PoolTraits::template allows<Components>(idx) ? comp_vec<Components>(idx).clear() : void()), ...);
+        touch_entities(idx);
+        (touch<Components>(idx), ...);
+        // }}}
+    }
+
+    //
+    // iteration
+    //
+
+    std::vector<Entity<ECS, Pool>> entities() {
+        // {{{ ...
+        return find_matching_entities<EntityType>(all_pools());
+        // }}}
+    }
+
+    std::vector<Entity<ECS, Pool>> entities(Pool pool) {
+        // {{{ ...
+        return find_matching_entities<EntityType>(single_pool(pool));
+        // }}}
+    }
+
+    template <typename... T>
+    std::vector<Entity<ECS, Pool>> entities() {
+        // {{{ ...
+        return find_matching_entities<EntityType, T...>(all_pools());
+        // }}}
+    }
+
+    template <typename... T>
+    std::vector<Entity<ECS, Pool>> entities(Pool pool) {
+        // {{{ ...
+        return find_matching_entities<EntityType, T...>(single_pool(pool));
+        // }}}
+    }
+
+    std::vector<ConstEntity<ECS, Pool>> entities() const {
+        // {{{ ...
+        return find_matching_entities<ConstEntityType>(all_pools());
+        // }}}
+    }
+
+    std::vector<ConstEntity<ECS, Pool>> entities(Pool pool) const {
+        // {{{ ...
+        return find_matching_entities<ConstEntityType>(single_pool(pool));
+        // }}}
+    }
+
+    template <typename... T>
+    std::vector<ConstEntity<ECS, Pool>> entities() const {
+        // {{{ ...
+        return find_matching_entities<ConstEntityType, T...>(all_pools());
+        // }}}
+    }
+
+    template <typename... T>
+    std::vector<ConstEntity<ECS, Pool>> entities(Pool pool) const {
+        // {{{ ...
+        return find_matching_entities<ConstEntityType, T...>(single_pool(pool));
+        // }}}
+    }
+
+    // the same as `entities`, but in a vector given by the caller (that is cleared first), reusing its memory
+    template <typename... T>
+    void collect(std::vector<Entity<ECS, Pool>>& entities) {
+        // {{{ ...
+        collect_matching_entities<EntityType, T...>(all_pools(), entities);
+        // }}}
+    }
+
+    template <typename... T>
+    void collect(Pool pool, std::vector<Entity<ECS, Pool>>& entities) {
+        // {{{ ...
+        collect_matching_entities<EntityType, T...>(single_pool(pool), entities);
+        // }}}
+    }
+
+    template <typename... T>
+    void collect(std::vector<ConstEntity<ECS, Pool>>& entities) const {
+        // {{{ ...
+        collect_matching_entities<ConstEntityType, T...>(all_pools(), entities);
+        // }}}
+    }
+
+    template <typename... T>
+    void collect(Pool pool, std::vector<ConstEntity<ECS, Pool>>& entities) const {
+        // {{{ ...
+        collect_matching_entities<ConstEntityType, T...>(single_pool(pool), entities);
+        // }}}
+    }
+
+    // writes the entities to an output iterator, returning the iterator past the last one written
+    template <typename... T, typename OutputIt>
+    OutputIt collect(OutputIt out) {
+        // {{{ ...
+        return write_matching_entities<EntityType, T...>(all_pools(), out);
+        // }}}
+    }
+
+    template <typename... T, typename OutputIt>
+    OutputIt collect(Pool pool, OutputIt out) {
+        // {{{ ...
+        return write_matching_entities<EntityType, T...>(single_pool(pool), out);
+        // }}}
+    }
+
+    template <typename... T, typename OutputIt>
+    OutputIt collect(OutputIt out) const {
+        // {{{ ...
+        return write_matching_entities<ConstEntityType, T...>(all_pools(), out);
+        // }}}
+    }
+
+    template <typename... T, typename OutputIt>
+    OutputIt collect(Pool pool, OutputIt out) const {
+        // {{{ ...
+        return write_matching_entities<ConstEntityType, T...>(single_pool(pool), out);
+        // }}}
+    }
+
+    template <typename... T>
+    std::vector<Entity<ECS, Pool>> entities(Order order) {
+        // {{{ ...
+        return in_order(find_matching_entities<EntityType, T...>(all_pools()), order);
+        // }}}
+    }
+
+    template <typename... T>
+    std::vector<ConstEntity<ECS, Pool>> entities(Order order) const {
+        // {{{ ...
+        return in_order(find_matching_entities<ConstEntityType, T...>(all_pools()), order);
+        // }}}
+    }
+
+    // calls `fn(entity, components...)` for each matching entity, without creating the list of entities
+    template <typename... T, typename F>
+    void each(F&& fn) {
+        // {{{ ...
+        each_entity<EntityType, T...>(*this, all_pools(), fn);
+        // }}}
+    }
+
+    template <typename... T, typename F>
+    void each(Pool pool, F&& fn) {
+        // {{{ ...
+        each_entity<EntityType, T...>(*this, single_pool(pool), fn);
+        // }}}
+    }
+
+    template <typename... T, typename F>
+    void each(F&& fn) const {
+        // {{{ ...
+        each_entity<ConstEntityType, T...>(*this, all_pools(), fn);
+        // }}}
+    }
+
+    template <typename... T, typename F>
+    void each(Pool pool, F&& fn) const {
+        // {{{ ...
+        each_entity<ConstEntityType, T...>(*this, single_pool(pool), fn);
+        // }}}
+    }
+
+    // number of entities that match the components, without building the list
+    template <typename C, typename... F>
+    size_t count() const {
+        // {{{ ...
+        return count_matching<C, F...>(all_pools());
+        // }}}
+    }
+
+    template <typename C, typename... F>
+    size_t count(Pool pool) const {
+        // {{{ ...
+        return count_matching<C, F...>(single_pool(pool));
+        // }}}
+    }
+
+    template <typename C, typename... F>
+    bool any() const {
+        // {{{ ...
+        return first_matching<ConstEntityType, C, F...>(all_pools()).has_value();
+        // }}}
+    }
+
+    template <typename C, typename... F>
+    bool any(Pool pool) const {
+        // {{{ ...
+        return first_matching<ConstEntityType, C, F...>(single_pool(pool)).has_value();
+        // }}}
+    }
+
+    // the first entity found that matches the components
+    template <typename C, typename... F>
+    std::optional<Entity<ECS, Pool>> first() {
+        // {{{ ...
+        return first_matching<EntityType, C, F...>(all_pools());
+        // }}}
+    }
+
+    template <typename C, typename... F>
+    std::optional<Entity<ECS, Pool>> first(Pool pool) {
+        // {{{ ...
+        return first_matching<EntityType, C, F...>(single_pool(pool));
+        // }}}
+    }
+
+    template <typename C, typename... F>
+    std::optional<ConstEntity<ECS, Pool>> first() const {
+        // {{{ ...
+        return first_matching<ConstEntityType, C, F...>(all_pools());
+        // }}}
+    }
+
+    template <typename C, typename... F>
+    std::optional<ConstEntity<ECS, Pool>> first(Pool pool) const {
+        // {{{ ...
+        return first_matching<ConstEntityType, C, F...>(single_pool(pool));
+        // }}}
+    }
+
+    // ids of the entities whose component was removed (or that were destroyed) since the last run of the running system
+    template <typename C>
+    std::vector<Id> removed() const {
+        // {{{ ...
+        return ticks_of<Changed<C>>()->removed_since(_last_run);
+        // }}}
+    }
+
+    //
+    // cached queries
+    //
+
+    // Returns an object that keeps the result of `entities<C...>()`, and only searches the entities
+    // again when a component (or entity) is added, removed or moved in the pools it covers.
+    template <typename... C>
+    class Query;
+
+    template <typename... C>
+    Query<C...> query() {
+        // {{{ ...
+        return Query<C...>(this, std::nullopt);
+        // }}}
+    }
+
+    template <typename... C>
+    Query<C...> query(Pool pool) {
+        // {{{ ...
+        return Query<C...>(this, pool);
+        // }}}
+    }
+
+    //
+    // groups
+    //
+
+    // Declares an owning group: the storages of these components are kept ordered so that the entities
+    // that have all of them are in the same positions `[0, n)` of each storage.
+    template <typename... G>
+    void add_group() {
+        // {{{ ...
+        static_assert(sizeof...(G) >= 2, "A group needs at least two components.");
+        static_assert((groupable<G> && ...), "Only components with a dense storage can be part of a group.");
+        ((check_component<G>(), ...));
+        if (((group_of<G>() != 0) || ...))
+            throw ECSError("A component can only be owned by one group.");
+
+        _group_sizes.push_back(sizeof...(G));
+        size_t g = _group_sizes.size();
+        ((_group_of[component_index<G>()] = g), ...);
+
+        // sort the entities that already have all the components
+        using First = std::tuple_element_t<0, std::tuple<G...>>;
+        PoolRange pools = all_pools();
+        for (size_t idx = pools.first; idx < pools.last; ++idx) {
+            if (!(PoolTraits::template allows<G>(idx) && ...))
+                continue;
+            std::vector<Id> ids = comp_vec<First>(idx).ids();
+            for (Id id : ids)
+                if (group_has_all(g, id, idx))
+                    enter_group(g, id, idx);
+        }
+        // }}}
+    }
+
+    // The components of the entities of a group, accessed by position (defined below).
+    template <typename... G>
+    class Group;
+
+    template <typename... G>
+    Group<G...> group() {
+        // {{{ ...
+        return group<G...>(DefaultPool);
+        // }}}
+    }
+
+    template <typename... G>
+    Group<G...> group(Pool pool) {
+        // {{{ ...
+        size_t g = group_of<std::tuple_element_t<0, std::tuple<G...>>>();
+        if (g == 0 || !((group_of<G>() == g) && ...) || _group_sizes[g - 1] != sizeof...(G))
+            throw ECSError("These components were not declared as a group.");
+
+        Group<G...> group;
+        group._ecs = this;
+        size_t idx = checked_pool_index(pool);
+        if (idx != NoPoolIndex && (PoolTraits::template allows<G>(idx) && ...)) {
+            group._storages = { &comp_vec<G>(idx)... };
+            group._size = std::get<0>(group._storages)->group_size();
+        }
+        return group;
+        // }}}
+    }
+
+    //
+    // observers
+    //
+
+    // `fn(entity)` is called after the component is added, and before it's removed (also when the entity
+    // is destroyed). The batched versions receive the ids affected since the last `flush_observers()`.
+    template <typename C>
+    void on_add(std::function<void(EntityType&)> fn) {
+        static_assert(observe<C>::value, "This component can't be observed (see `observe`).");
+        observers<C>().on_add.push_back(std::move(fn));
+    }
+
+    template <typename C>
+    void on_remove(std::function<void(EntityType&)> fn) {
+        static_assert(observe<C>::value, "This component can't be observed (see `observe`).");
+        observers<C>().on_remove.push_back(std::move(fn));
+    }
+
+    template <typename C>
+    void on_add_batch(std::function<void(std::vector<Id> const&)> fn) {
+        static_assert(observe<C>::value, "This component can't be observed (see `observe`).");
+        observers<C>().on_add_batch.push_back(std::move(fn));
+    }
+
+    template <typename C>
+    void on_remove_batch(std::function<void(std::vector<Id> const&)> fn) {
+        static_assert(observe<C>::value, "This component can't be observed (see `observe`).");
+        observers<C>().on_remove_batch.push_back(std::move(fn));
+    }
+
+    // delivers the ids collected for the batched observers (also called after each `run_mutable`)
+    void flush_observers() {
+        // {{{ ...
+        (flush_observers_of<Components>(), ...);
+        // }}}
+    }
+
+    //
+    // globals
+    //
+
+    Global& operator()()                        { return _global; }
+    Global const& operator()() const            { return _global; }
+
+    //
+    // messages
+    //
+
+    void add_message(Message&& e) const {
+        // {{{ ...
+        if (_running_mt)
+            _messages.push_sync(std::move(e), _current_system);
+        else
+            _messages.push_nosync(std::move(e), _current_system);
+        // }}}
+    }
+
+    template<typename T>
+    std::vector<T> messages() const {
+        // {{{ ...
+        std::vector<T> r;
+        for (std::pair<Message, SystemPtr> ev : _messages.underlying_vector())
+            if (std::holds_alternative<T>(ev.first))
+                r.push_back(std::get<T>(ev.first));
+        return r;
+        // }}}
+    }
+
+    template<typename T>
+    std::vector<T> pop_messages() const {
+        // {{{ ...
+        std::vector<T> r;
+        for (std::pair<Message, SystemPtr> ev : _messages.underlying_vector())
+            if (std::holds_alternative<T>(ev.first))
+                r.push_back(std::get<T>(ev.first));
+        _messages.template clear_with_type<T>();
+        return r;
+    }
+
+    void clear_messages()                       { _messages.clear(); }
+
+    //
+    // systems
+    //
+
+    void start_frame() {
+        // {{{ ...
+        _timer.start_frame();
+
+        // forget the removed components that every system has already seen
+        if (!_system_ticks.empty()) {
+            uint64_t seen = *std::min_element(_system_ticks.begin(), _system_ticks.end());
+            for (auto& ticks: _ticks)
+                ticks.forget_removed(seen);
+        }
+        // }}}
+    }
+    void reset_timer()                          { _timer.reset(); }
+
+    std::vector<SystemTime> timer_st() const { return _timer.timer(false); }
+    std::vector<SystemTime> timer_mt() const { return _timer.timer(true); }
+
+    // {{{ auxiliary methods
+private:
+    using Time = std::chrono::time_point<std::chrono::high_resolution_clock>;
+
+    static Time now() { return std::chrono::high_resolution_clock::now(); }
+
+    void add_time(std::string const& name, Time start, bool mt) const {
+        _timer.add_time(name, std::chrono::duration_cast<std::chrono::microseconds>(now() - start), mt);
+    }
+
+    // finds the index of the system, or registers it (always in the thread that runs the systems, not in
+    // the threads of `run_mt`)
+    SystemPtr system_index(std::string const& system_name) const {
+        // {{{ ...
+        auto it = _system_idx.find(system_name);
+        if (it != _system_idx.end())  // more likely branch
+            return it->second;
+        SystemPtr system = 0;
+        if (!_system_idx.empty())
+            system = static_cast<SystemPtr>(std::max_element(_system_idx.begin(), _system_idx.end(),
+                [](auto const& a, auto const& b) { return a.second < b.second; })->second + 1);
+        _system_idx[system_name] = system;
+        std::lock_guard<std::mutex> lock(_system_ticks_mutex);
+        _system_ticks.resize(static_cast<size_t>(system) + 1, 0);
+        return system;
+        // }}}
+    }
+
+    void update_current_system(SystemPtr system) const {
+        _current_system = system;
+        start_system_ticks();
+    }
+
+    void update_current_system(std::string const& system_name) const {
+        update_current_system(system_index(system_name));
+    }
+    // }}}
+
+public:
+    template<typename F, typename... P>
+    void run_st(std::string const& name, F f, P&& ...pars) const {
+        // {{{ ...
+        auto start = now();
+        update_current_system(name);
+        _messages.clear_with_system(_current_system);
+        f(*this, pars...);
+        end_system_ticks();
+        add_time(name, start, false);
+        // }}}
+    }
+
+    template<typename O, typename F, typename... P, class = typename std::enable_if<std::is_class<O>::value>::type>
+    void run_st(std::string const& name, O& obj, F f, P&& ...pars) const {
+        // {{{ ...
+        auto start = now();
+        update_current_system(name);
+        _messages.clear_with_system(_current_system);
+        (obj.*f)(*this, pars...);
+        end_system_ticks();
+        add_time(name, start, false);
+        // }}}
+    }
+
+    template<typename F, typename... P>
+    void run_mutable(std::string const& name, F f, P&& ...pars) {
+        // {{{ ...
+        auto start = now();
+        update_current_system(name);
+        _messages.clear_with_system(_current_system);
+        f(*this, pars...);
+        end_system_ticks();
+        flush_observers();
+        add_time(name, start, false);
+        // }}}
+    }
+
+    template<typename O, typename F, typename... P, class = typename std::enable_if<std::is_class<O>::value>::type>
+    void run_mutable(std::string const& name, O& obj, F f, P&& ...pars) {
+        // {{{ ...
+        auto start = now();
+        update_current_system(name);
+        _messages.clear_with_system(_current_system);
+        (obj.*f)(*this, pars...);
+        end_system_ticks();
+        flush_observers();
+        add_time(name, start, false);
+        // }}}
+    }
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wparentheses"
+
+    template<typename F, typename... P>
+    void run_mt(std::string const& name, F f, P&& ...pars) const {
+        // {{{ ...
+        static_assert(!(((std::is_reference_v<P> && !std::is_const_v<P>) || ...)),
+                      "Don't use non-const references in multithreaded code. Use pointers instead.");
+        if (_threading == Threading::Single) {
+            run_st(name, f, pars...);
+        } else {
+            SystemPtr system = system_index(name);
+            _threads.emplace_back([this, system](std::string name, MyECS const& ecs, auto f, auto... pars) {
+                auto start = now();
+                update_current_system(system);
+                _messages.clear_with_system(_current_system);
+                f(ecs, pars...);
+                end_system_ticks();
+                ecs.add_time(name, start, true);
+            }, name, std::ref(*this), f, pars...);
+        }
+        // }}}
+    }
+
+    template<typename O, typename F, typename... P, class = typename std::enable_if<std::is_class<O>::value>::type>
+    void run_mt(std::string const& name, O& obj, F f, P&& ...pars) const {
+        // {{{ ...
+        static_assert(!(((std::is_reference_v<P> && !std::is_const_v<P>) || ...)),
+                      "Don't use non-const references in multithreaded code. Use pointers instead.");
+        if (_threading == Threading::Single) {
+            run_st(name, obj, f, pars...);
+        } else {
+            SystemPtr system = system_index(name);
+            _threads.emplace_back([this, system](auto* obj, std::string name, MyECS const& ecs, auto f, auto&... pars) {
+                auto start = now();
+                update_current_system(system);
+                _messages.clear_with_system(_current_system);
+                std::invoke(f, obj, ecs, pars...);
+                end_system_ticks();
+                ecs.add_time(name, start, true);
+            }, &obj, name, std::ref(*this), f, pars...);
+        }
+        // }}}
+    }
+
+#pragma GCC diagnostic push
+
+    void join() {
+        // {{{ ...
+        for (std::thread& t: _threads)
+            t.join();
+        _threads.clear();
+        // }}}
+    }
+
+    friend class ConstEntity<ECS, Pool>;
+    friend class Entity<ECS, Pool>;
+
+    //
+    // debugging
+    //
+
+    std::string debug_entities(size_t spaces=0) const            { return debug_entities(all_pools(), spaces); }
+    std::string debug_entities(Pool pool, size_t spaces=0) const { return debug_entities(single_pool(pool), spaces); }
+
+    std::string debug_global() const {
+        // {{{ ...
+        std::stringstream ss;
+        ss << "{ " << _global << " }";
+        return ss.str();
+        // }}}
+    }
+
+    std::string debug_all() const {
+        // {{{
+        return std::string("{\n   global = ") + debug_global() + ",\n   entities = " + debug_entities(all_pools(), 3) + "\n}";
+        // }}}
+    }
+
+    template <typename... C>
+    std::string debug_entities(size_t spaces=0) const
+    {
+        // {{{ ...
+        auto entities = find_matching_entities<ConstEntityType>(all_pools());
+        std::sort(entities.begin(), entities.end());
+
+        std::string s = "{\n";
+        for (auto const& ent : entities) {
+            bool print = ((ent.template has<C>() || ...));
+            if (print) {
+                s += std::string(spaces, ' ') + std::string("   [");
+                s += std::to_string(ent.id);
+                s += "] = " + ent.debug() + ",\n";
+            }
+        }
+        return s + std::string(spaces, ' ') + "}";
+        // }}}
+    }
+
+    size_t number_of_entities() const               { return size_to_reserve(all_pools()); }
+    size_t number_of_components() const             { return sizeof...(Components); }
+    size_t number_of_message_types() const {
+        // {{{ ...
+        if constexpr (std::is_same<Message, NoMessageQueue>::value)
+            return 0;
+        return std::variant_size_v<Message>;
+        // }}}
+    }
+    size_t message_queue_size() const               { return _messages.size(); }
+
+private:
+
+    // {{{ templates & static assertions
+
+#if __cplusplus < 201703L
+#error "A compiler with C++17 support is required."
+#endif
+
+    // create a tuple from the component list
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-value"
+
+    static_assert(sizeof...(Components) > 0, "Add at least one component.");
+
+    static_assert((std::is_move_constructible_v<Components> && ...), "All components must be movable.");
+
+    template <typename>      struct is_std_variant : std::false_type {};
+    template <typename... T> struct is_std_variant<std::variant<T...>> : std::true_type {};
+    static_assert(is_std_variant<Message>::value, "Message must be a std::variant<...>.");
+
+#pragma GCC diagnostic pop
+
+    // check if component is on the list
+    template <typename C>
+    void check_component() const {
+        static_assert((std::is_same_v<C, Components> || ...), "This component is not part of the component list given in the Engine initialization.");
+    }
+
+    // check if pool is an enum
+    static_assert(std::is_enum_v<Pool>, "Pool must be an enum.");
+
+    // check the id type
+    static_assert(std::is_integral_v<Id> && std::is_unsigned_v<Id>, "The entity id must be an unsigned integer.");
+
+    // check if the pool restrictions only name known components
+    static_assert(PoolTraits::template uses_only<Components...>, "PoolComponents names a component that is not part of the component list.");
+
+    // pool storage
+
+    // the ids of the entities of a pool, in ascending order, so that they are iterated in the same
+    // order in every run (erasing a single id is linear, like erasing a component; the batches are
+    // erased in one pass)
+    class EntityPool {
+    public:
+        size_t size() const                 { return _ids.size(); }
+        auto   begin() const                { return _ids.begin(); }
+        auto   end() const                  { return _ids.end(); }
+        void   clear()                      { _ids.clear(); }
+
+        void insert(Id id) {
+            if (_ids.empty() || _ids.back() < id)   // most common case: a new entity
+                _ids.push_back(id);
+            else
+                _ids.insert(std::lower_bound(_ids.begin(), _ids.end(), id), id);
+        }
+
+        void erase(Id id) {
+            auto it = std::lower_bound(_ids.begin(), _ids.end(), id);
+            if (it != _ids.end() && *it == id)
+                _ids.erase(it);
+        }
+
+        // `ids` must be sorted
+        void insert(std::vector<Id> const& ids) {
+            size_t n = _ids.size();
+            _ids.insert(_ids.end(), ids.begin(), ids.end());
+            std::inplace_merge(_ids.begin(), _ids.begin() + static_cast<std::ptrdiff_t>(n), _ids.end());
+        }
+
+        void erase(std::vector<Id> const& ids) {
+            _ids.erase(std::remove_if(_ids.begin(), _ids.end(),
+                                      [&](Id id) { return std::binary_search(ids.begin(), ids.end(), id); }),
+                       _ids.end());
+        }
+
+    private:
+        std::vector<Id> _ids {};
+    };
+
+    // entity directory entry, also pointed by the entity handles
+    struct EntitySlot {
+        Id       id;
+        Pool     pool;
+        uint32_t generation;
+        bool     alive;
+    };
+
+    // the observers of a component, and the ids waiting for the batched observers
+    template <typename C>
+    struct Observers {
+        std::vector<std::function<void(EntityType&)>>             on_add          {};
+        std::vector<std::function<void(EntityType&)>>             on_remove       {};
+        std::vector<std::function<void(std::vector<Id> const&)>>  on_add_batch    {};
+        std::vector<std::function<void(std::vector<Id> const&)>>  on_remove_batch {};
+        std::vector<Id>                                           added           {};
+        std::vector<Id>                                           removed         {};
+    };
+
+    // a range of pool slots, to iterate a single pool or all of them
+    struct PoolRange {
+        size_t first, last;
+    };
+
+    struct PoolData {
+        EntityPool           entities   {};
+        std::array<uint64_t, sizeof...(Components) + 1> versions {};   // last change of each component, and of the entity list
+    };
+
+    static constexpr Pool DefaultPool = static_cast<Pool>(std::numeric_limits<typename std::underlying_type<Pool>::type>::max());
+    static constexpr size_t DefaultPoolIndex = PoolTraits::fixed ? PoolTraits::count : 0;
+    static constexpr size_t NoPoolIndex = std::numeric_limits<size_t>::max();
+
+    // pools declared with `Pools<E, N>` live in an array indexed by the enum value (the default pool is
+    // the last one); other pools live in a deque (so references stay valid) in the order they were registered
+    using PoolContainer = std::conditional_t<PoolTraits::fixed,
+                                             std::array<PoolData, PoolTraits::count + 1>,
+                                             std::deque<PoolData>>;
+
+    // component storage: for each component, one storage per pool that accepts it
+    template <typename C>
+    using ComponentVector = ComponentStorage<Id, C>;
+
+    template <typename C>
+    static constexpr size_t component_pool_count() {
+        // {{{ ...
+        if constexpr (PoolTraits::fixed) {
+            size_t n = 0;
+            for (size_t idx = 0; idx <= PoolTraits::count; ++idx)
+                n += PoolTraits::template allows<C>(idx) ? 1 : 0;
+            return n;
+        }
+        return 0;
+        // }}}
+    }
+
+public:
+    // The components of the entities of a group, accessed by position.
+    template <typename... G>
+    class Group {
+    public:
+        size_t size() const                 { return _size; }
+        Id     id(size_t i) const           { return std::get<0>(_storages)->ids()[i]; }
+
+        template <typename C>
+        ComponentRef<C> get(size_t i) const {
+            _ecs->template record_change<C>(id(i));
+            return std::get<ComponentVector<C>*>(_storages)->at(i);
+        }
+
+    private:
+        friend class BasicECS;
+        MyECS*                             _ecs      = nullptr;
+        std::tuple<ComponentVector<G>*...> _storages {};
+        size_t                             _size     = 0;
+    };
+
+    // The result of `entities<C...>()`, that is only searched again when components are added or removed.
+    template <typename... C>
+    class Query {
+    public:
+        std::vector<Entity<MyECS, Pool>> const& entities() { refresh(); return _entities; }
+        size_t size()                                      { refresh(); return _entities.size(); }
+
+        auto begin()                        { refresh(); return _entities.begin(); }
+        auto end()                          { return _entities.end(); }
+
+        Query(Query const&) = default;
+        Query& operator=(Query const&) = default;
+
+    private:
+        friend class BasicECS;
+        Query(MyECS* ecs, std::optional<Pool> pool) : _ecs(ecs), _pool(pool) {}
+
+        void refresh() {
+            // the change filters depend on the system that is running, so their result is never reused
+            constexpr bool tracks_changes = ((filter_traits<C>::change != ChangeFilter::None) || ...);
+            PoolRange pools = _pool ? _ecs->single_pool(*_pool) : _ecs->all_pools();
+            if (_computed && pools.first == _pools.first && pools.last == _pools.last && !tracks_changes
+                    && !_ecs->template changed_since<C...>(pools, _version))
+                return;
+            _entities = _ecs->template find_matching_entities<EntityType, C...>(pools);
+            _pools = pools;
+            _version = _ecs->_version;
+            _computed = true;
+        }
+
+        MyECS*                           _ecs;
+        std::optional<Pool>              _pool;
+        std::vector<Entity<MyECS, Pool>> _entities {};
+        PoolRange                        _pools    { 0, 0 };
+        uint64_t                         _version  = 0;
+        bool                             _computed = false;
+    };
+
+private:
+    // maps the pool slot to the position of the component vector in the component storage
+    template <typename C>
+    static constexpr std::array<size_t, PoolTraits::count + 1> component_slots() {
+        // {{{ ...
+        std::array<size_t, PoolTraits::count + 1> slots {};
+        size_t n = 0;
+        for (size_t idx = 0; idx <= PoolTraits::count; ++idx)
+            slots[idx] = PoolTraits::template allows<C>(idx) ? n++ : NoPoolIndex;
+        return slots;
+        // }}}
+    }
+
+    template <typename C>
+    using ComponentPools = std::conditional_t<PoolTraits::fixed,
+                                              std::array<ComponentVector<C>, component_pool_count<C>()>,
+                                              std::deque<ComponentVector<C>>>;
+
+    using ComponentStorage = std::tuple<ComponentPools<Components>...>;
+
+    // }}}
+
+    // {{{ private methods (iteration)
+
+    size_t size_to_reserve(PoolRange pools) const {
+        size_t size = 0;
+        for (size_t idx = pools.first; idx < pools.last; ++idx)
+            size += _pools[idx].entities.size();
+        return size;
+    }
+
+    // the entities of each pool are already in ascending order, so the pools are merged one by one
+    template <typename E>
+    static std::vector<E> in_order(std::vector<E>&& entities, Order order) {
+        // {{{ ...
+        if (order == Order::ById) {
+            auto by_id = [](E const& a, E const& b) { return a.id < b.id; };
+            auto merged = std::is_sorted_until(entities.begin(), entities.end(), by_id);
+            while (merged != entities.end()) {
+                auto pool_end = std::is_sorted_until(merged, entities.end(), by_id);
+                std::inplace_merge(entities.begin(), merged, pool_end, by_id);
+                merged = pool_end;
+            }
+        }
+        return std::move(entities);
+        // }}}
+    }
+
+    // entities are created as non-const only by the non-const public methods
+    template <typename E>
+    auto entity_owner() const {
+        if constexpr (std::is_same_v<E, EntityType>)
+            return const_cast<MyECS*>(this);
+        else
+            return this;
+    }
+
+    template <typename E, typename... F>
+    std::vector<E> find_matching_entities(PoolRange pools) const {
+        // {{{ ...
+        size_t size = size_to_reserve(pools);
+        if (size == 0)
+            return {};
+        std::vector<E> entities;
+        entities.reserve(size);
+        write_matching_entities<E, F...>(pools, std::back_inserter(entities));
+        return entities;
+        // }}}
+    }
+
+    // the caller's vector keeps its capacity, so it's only allocated while it grows
+    template <typename E, typename... F>
+    void collect_matching_entities(PoolRange pools, std::vector<E>& entities) const {
+        // {{{ ...
+        entities.clear();
+        entities.reserve(size_to_reserve(pools));
+        write_matching_entities<E, F...>(pools, std::back_inserter(entities));
+        // }}}
+    }
+
+    template <typename E, typename... F, typename OutputIt>
+    OutputIt write_matching_entities(PoolRange pools, OutputIt out) const {
+        // {{{ ...
+        if constexpr (sizeof...(F) == 0) {
+            for (size_t idx = pools.first; idx < pools.last; ++idx)
+                for (Id id: _pools[idx].entities)
+                    *out++ = E(id, pool_at(idx), entity_owner<E>());
+        } else {
+            match<F...>(pools, [&](Id id, size_t idx, auto const&) {
+                *out++ = E(id, pool_at(idx), entity_owner<E>());
+            });
+        }
+        return out;
+        // }}}
+    }
+
+    // Calls `f(id, pool_idx, positions)` for each entity that matches the filters, where `positions` are the
+    // positions of the components (of each filter) in their storages (`npos` when a `Maybe` is missing).
+    // If `f` returns a bool, the search stops when it returns false.
+    template <typename... F, typename Fn>
+    void match(PoolRange pools, Fn&& f) const {
+        // {{{ ...
+        ((check_component<filter_component_t<F>>(), ...));
+
+        constexpr size_t N = sizeof...(F);
+        constexpr std::array<FilterKind, N> kinds {{ filter_traits<F>::kind... }};
+        static_assert(((filter_traits<F>::kind == FilterKind::Required) || ...), "At least one component must be required.");
+
+        // the change filters compare the ticks of the entity with the last run of the running system
+        constexpr std::array<ChangeFilter, N> changes {{ filter_traits<F>::change... }};
+        std::array<ChangeTicks<Id> const*, N> ticks {{ ticks_of<F>()... }};
+        uint64_t since = _last_run;
+        auto unchanged = [&](Id id) {
+            for (size_t k = 0; k < N; ++k)
+                if (changes[k] != ChangeFilter::None && !ticks[k]->since(id_index(id), since, changes[k]))
+                    return true;
+            return false;
+        };
+
+        // with more than one constraint, the bitsets of the components find the candidate ids before the
+        // id columns are searched
+        std::array<IdBitset const*, N> required_bits {}, excluded_bits {};
+        size_t n_required = 0, n_excluded = 0;
+        std::array<IdBitset const*, N> bits {{ &_bits[component_index<filter_component_t<F>>()]... }};
+        for (size_t k = 0; k < N; ++k) {
+            if (kinds[k] == FilterKind::Required)
+                required_bits[n_required++] = bits[k];
+            else if (kinds[k] == FilterKind::Excluded)
+                excluded_bits[n_excluded++] = bits[k];
+        }
+        bool prefilter = n_required + n_excluded > 1;
+
+        for (size_t idx = pools.first; idx < pools.last; ++idx) {
+            // skip pools that can't hold one of the required components
+            if (!((filter_traits<F>::kind != FilterKind::Required || PoolTraits::template allows<filter_component_t<F>>(idx)) && ...))
+                continue;
+
+            // when the components are exactly an owning group, the entities are the start of the storage
+            using First = filter_component_t<std::tuple_element_t<0, std::tuple<F...>>>;
+            size_t g = group_of<First>();
+            if (g != 0 && ((filter_traits<F>::kind == FilterKind::Required && group_of<filter_component_t<F>>() == g) && ...)
+                    && _group_sizes[g - 1] == N) {
+                auto const& storage = comp_vec<First>(idx);
+                std::array<size_t, N> positions {};
+                for (size_t i = 0; i < storage.group_size(); ++i) {
+                    if (unchanged(storage.ids()[i]))
+                        continue;
+                    positions.fill(i);
+                    if (!keep_matching(f, storage.ids()[i], idx, positions))
+                        return;
+                }
+                continue;
+            }
+
+            // one cursor on the id column of each component (empty if the pool can't hold it)
+            std::array<IdCursor<Id>, N> cursors {{ cursor_of<filter_component_t<F>>(idx)... }};
+            std::array<size_t, N> positions {};
+
+            JoinPlan<N> plan = plan_join(cursors, kinds);
+            plan.gallop[plan.order[0]] = plan.gallop[plan.order[0]] || prefilter;
+            auto advance = [&](size_t k, Id id) {
+                if (plan.gallop[k])
+                    cursors[k].gallop(id);
+                else
+                    cursors[k].seek(id);
+            };
+
+            IdCursor<Id>& driver = cursors[plan.order[0]];
+            while (!driver.done()) {
+                // move the required cursors to the id of the driver, skipping the blocks of ids that didn't
+                // change; when one of them passes it, the driver catches up and the search starts again
+                Id target = driver.id();
+                if (prefilter) {
+                    size_t next = IdBitset::next(required_bits, n_required, excluded_bits, n_excluded, id_index(target));
+                    if (next == IdBitset::npos)
+                        break;
+                    target = id_at(next, idx);
+                }
+                bool done = false, matched = true;
+                for (size_t r = 0; r < plan.required && !done && matched; ++r) {
+                    size_t k = plan.order[r];
+                    advance(k, target);
+                    if (changes[k] != ChangeFilter::None && !cursors[k].done())
+                        cursors[k].seek(id_at(ticks[k]->next_in_changed_block(id_index(cursors[k].id()), since, changes[k]), idx));
+                    done = cursors[k].done();
+                    matched = !done && cursors[k].id() == target;
+                    if (!done && !matched)
+                        target = cursors[k].id();
+                    positions[k] = done ? 0 : cursors[k].position();
+                }
+                if (done)
+                    break;
+                if (!matched) {
+                    driver.seek(target);
+                    continue;
+                }
+
+                // the excluded and optional cursors follow the required ones
+                bool excluded = false;
+                for (size_t k = 0; k < N; ++k) {
+                    if (kinds[k] == FilterKind::Required)
+                        continue;
+                    advance(k, target);
+                    bool found = !cursors[k].done() && cursors[k].id() == target;
+                    excluded = excluded || (kinds[k] == FilterKind::Excluded && found);
+                    positions[k] = found ? cursors[k].position() : IdColumn<Id>::npos;
+                }
+
+                if (!excluded && !unchanged(target) && !keep_matching(f, target, idx, positions))
+                    return;
+                driver.next();
+            }
+        }
+        // }}}
+    }
+
+    template <typename Fn, size_t N>
+    static bool keep_matching(Fn& f, Id id, size_t idx, std::array<size_t, N> const& positions) {
+        if constexpr (std::is_same_v<decltype(f(id, idx, positions)), bool>) {
+            return f(id, idx, positions);
+        } else {
+            f(id, idx, positions);
+            return true;
+        }
+    }
+
+    // the number of entities that match the filters; a single component is counted by the size of its storages
+    template <typename... F>
+    size_t count_matching(PoolRange pools) const {
+        // {{{ ...
+        using First = std::tuple_element_t<0, std::tuple<F...>>;
+        size_t n = 0;
+        if constexpr (sizeof...(F) == 1 && filter_traits<First>::kind == FilterKind::Required
+                      && filter_traits<First>::change == ChangeFilter::None) {
+            using C = filter_component_t<First>;
+            check_component<C>();
+            for (size_t idx = pools.first; idx < pools.last; ++idx)
+                n += PoolTraits::template allows<C>(idx) ? comp_vec<C>(idx).size() : 0;
+        } else {
+            match<F...>(pools, [&](Id, size_t, auto const&) { ++n; });
+        }
+        return n;
+        // }}}
+    }
+
+    template <typename E, typename... F>
+    std::optional<E> first_matching(PoolRange pools) const {
+        // {{{ ...
+        std::optional<E> found;
+        match<F...>(pools, [&](Id id, size_t idx, auto const&) {
+            found.emplace(id, pool_at(idx), entity_owner<E>());
+            return false;
+        });
+        return found;
+        // }}}
+    }
+
+    // A cursor much larger than the smallest required one (the driver of the join) gallops to the next id,
+    // instead of walking one id at a time.
+    static constexpr size_t GallopRatio = 8;
+
+    template <size_t N>
+    struct JoinPlan {
+        std::array<size_t, N> order    {};     // the required cursors, from the smallest
+        size_t                required = 0;
+        std::array<bool, N>   gallop   {};
+    };
+
+    // orders the join by the current sizes of the storages, so that the order of the components given
+    // by the user doesn't matter
+    template <size_t N>
+    static JoinPlan<N> plan_join(std::array<IdCursor<Id>, N> const& cursors, std::array<FilterKind, N> const& kinds) {
+        // {{{ ...
+        JoinPlan<N> plan;
+        for (size_t k = 0; k < N; ++k)
+            if (kinds[k] == FilterKind::Required)
+                plan.order[plan.required++] = k;
+        std::sort(plan.order.begin(), plan.order.begin() + static_cast<std::ptrdiff_t>(plan.required),
+                  [&](size_t a, size_t b) { return cursors[a].size() < cursors[b].size(); });
+
+        size_t driver_size = cursors[plan.order[0]].size();
+        for (size_t k = 0; k < N; ++k)
+            plan.gallop[k] = cursors[k].size() > GallopRatio * driver_size;
+        return plan;
+        // }}}
+    }
+
+    template <typename C>
+    IdCursor<Id> cursor_of(size_t idx) const {
+        if (!PoolTraits::template allows<C>(idx))
+            return {};
+        auto const& storage = comp_vec<C>(idx);
+        return IdCursor<Id>(storage.ids(), storage.group_size());
+    }
+
+    // Calls `fn(entity, components...)` for the entities that match the filters. `Self` is the ECS, const or not.
+    template <typename E, typename... F, typename Self, typename Fn>
+    static void each_entity(Self& self, PoolRange pools, Fn&& fn) {
+        // {{{ ...
+        self.template match<F...>(pools, [&](Id id, size_t idx, std::array<size_t, sizeof...(F)> const& positions) {
+            E entity(id, self.pool_at(idx), &self);
+            std::apply(fn, std::tuple_cat(std::forward_as_tuple(entity),
+                                          each_argument<F>(self, id, idx, positions[index_of<F, F...>()])...));
+        });
+        // }}}
+    }
+
+    // the argument given to `each` for a filter: a reference, a pointer (for `Maybe`) or nothing (for `Without`)
+    template <typename F, typename Self>
+    static auto each_argument([[maybe_unused]] Self& self, [[maybe_unused]] Id id, [[maybe_unused]] size_t idx, [[maybe_unused]] size_t pos) {
+        // {{{ ...
+        using C = filter_component_t<F>;
+        constexpr bool is_const = std::is_const_v<Self>;
+        if constexpr (!is_const && filter_traits<F>::kind != FilterKind::Excluded)
+            if (pos != IdColumn<Id>::npos)
+                self.template record_change<C>(id);
+        using Ref = std::conditional_t<is_const, ComponentConstRef<C>, ComponentRef<C>>;
+        using Ptr = std::conditional_t<is_const, ComponentConstPtr<C>, ComponentPtr<C>>;
+        if constexpr (filter_traits<F>::kind == FilterKind::Required)
+            return std::tuple<Ref>(self.template comp_vec<C>(idx).at(pos));
+        else if constexpr (filter_traits<F>::kind == FilterKind::Optional)
+            return std::tuple<Ptr>(pos == IdColumn<Id>::npos ? Ptr {} : component_type<C>::address(self.template comp_vec<C>(idx).at(pos)));
+        else
+            return std::tuple<>();
+        // }}}
+    }
+
+    // position of a type in a list of distinct types
+    template <typename T, typename... L>
+    static constexpr size_t index_of() {
+        constexpr bool same[] = { std::is_same_v<T, L>... };
+        size_t i = 0;
+        while (!same[i])
+            ++i;
+        return i;
+    }
+
+    // }}}
+
+    // {{{ private methods (components)
+
+    template<typename C, typename... P>
+    ComponentRef<C> add_component(Id id, Pool pool, P&& ...pars) {
+        // {{{ ...
+        check_component<C>();
+
+        size_t idx = pool_index(pool);
+        if (!PoolTraits::template allows<C>(idx))
+            throw ECSError(std::string("Component '") + type_name<C>() + "' is not allowed in the pool of entity " + std::to_string(id) + ".");
+
+        auto& storage = comp_vec<C>(idx);
+        if (storage.find(id) != ComponentVector<C>::npos)   // also looks in the group
+            throw ECSError(std::string("Component '") + type_name<C>() + "' already exist for entity " + std::to_string(id) + ".");
+        size_t i = storage.lower_bound(id);
+
+        ComponentRef<C> c = storage.emplace(i, id, std::forward<P>(pars)...);
+        touch<C>(idx);
+        record_add<C>(id);
+        _bits[component_index<C>()].set(id_index(id));
+        bool moved = group_of<C>() != 0;
+        if (moved)
+            enter_group_of<C>(id, idx);
+        if (observed<C>()) {
+            notify_add<C>(id, pool);    // the observers might add components, moving this one
+            moved = true;
+        }
+        if (!moved)
+            return c;
+        size_t j = comp_vec<C>(idx).find(id);
+        if (j == ComponentVector<C>::npos)
+            throw ECSError(std::string("Component '") + type_name<C>() + "' of entity " + std::to_string(id) + " was removed by an observer.");
+        return comp_vec<C>(idx).at(j);
+        // }}}
+    }
+
+    template<typename C>
+    ComponentRef<C> component(Id id, Pool pool) {
+        // {{{ ...
+        return component_of<C, ComponentRef<C>>(*this, id, pool);
+    }
+
+    template<typename C>
+    ComponentConstRef<C> component(Id id, Pool pool) const {
+        return component_of<C, ComponentConstRef<C>>(*this, id, pool);
+    }
+
+    template<typename C, typename Ref, typename Self>
+    static Ref component_of(Self& self, Id id, Pool pool) {
+        auto c = self.template component_ptr<C>(id, pool);
+        if (!c)
+            throw ECSError(std::string("Entity ") + std::to_string(id) + " has no component '" + type_name<C>() + "'.");
+        return *c;
+        // }}}
+    }
+
+    template<typename C>
+    ComponentPtr<C> component_ptr(Id id, Pool pool) {
+        // {{{ ...
+        auto c = component_ptr_of<C, ComponentPtr<C>>(*this, id, pool);
+        if (c)
+            record_change<C>(id);
+        return c;
+    }
+
+    template<typename C>
+    ComponentConstPtr<C> component_ptr(Id id, Pool pool) const {
+        return component_ptr_of<C, ComponentConstPtr<C>>(*this, id, pool);
+    }
+
+    // `Self` is the ECS, const or not, so the storage returns the matching kind of reference
+    template<typename C, typename Ptr, typename Self>
+    static Ptr component_ptr_of(Self& self, Id id, Pool pool) {
+        return component_ptr_in<C, Ptr>(self, id, self.pool_index(pool));
+    }
+
+    template<typename C, typename Ptr, typename Self>
+    static Ptr component_ptr_in(Self& self, Id id, size_t idx) {
+        self.template check_component<C>();
+
+        if (!PoolTraits::template allows<C>(idx))
+            return Ptr {};
+
+        auto& storage = self.template comp_vec<C>(idx);
+        size_t i = storage.find(id);
+        return i == ComponentVector<C>::npos ? Ptr {} : component_type<C>::address(storage.at(i));
         // }}}
     }
 
-#pragma GCC diagnostic push
+    // several components of an entity, resolving the pool only once
+    template<typename... C>
+    std::tuple<ComponentRef<C>...> components(Id id, Pool pool) {
+        // {{{ ...
+        size_t idx = pool_index(pool);
+        std::tuple<ComponentPtr<C>...> ptrs { component_ptr_in<C, ComponentPtr<C>>(*this, id, idx)... };
+        require_components<C...>(id, ptrs, std::index_sequence_for<C...>());
+        auto refs = components_of<ComponentRef<C>...>(ptrs, std::index_sequence_for<C...>());
+        (record_change<C>(id), ...);
+        return refs;
+        // }}}
+    }
 
-    void join() {
+    template<typename... C>
+    std::tuple<ComponentConstRef<C>...> components(Id id, Pool pool) const {
         // {{{ ...
-        for (std::thread& t: _threads)
-            t.join();
-        _threads.clear();
+        size_t idx = pool_index(pool);
+        std::tuple<ComponentConstPtr<C>...> ptrs { component_ptr_in<C, ComponentConstPtr<C>>(*this, id, idx)... };
+        require_components<C...>(id, ptrs, std::index_sequence_for<C...>());
+        return components_of<ComponentConstRef<C>...>(ptrs, std::index_sequence_for<C...>());
         // }}}
     }
 
-    friend class ConstEntity<ECS, Pool>;
-    friend class Entity<ECS, Pool>;
+    // throws naming the first component that the entity doesn't have
+    template<typename... C, typename Ptrs, size_t... I>
+    static void require_components(Id id, Ptrs const& ptrs, std::index_sequence<I...>) {
+        ((static_cast<bool>(std::get<I>(ptrs)) ? void()
+            : throw ECSError(std::string("Entity ") + std::to_string(id) + " has no component '" + type_name<C>() + "'.")), ...);
+    }
 
-    //
-    // debugging
-    //
+    template<typename... Ref, typename Ptrs, size_t... I>
+    static std::tuple<Ref...> components_of(Ptrs const& ptrs, std::index_sequence<I...>) {
+        return { *std::get<I>(ptrs)... };
+    }
 
-    std::string debug_entities(size_t spaces=0) const            { return debug_entities(_pool_set, spaces); }
-    std::string debug_entities(Pool pool, size_t spaces=0) const { return debug_entities(std::vector<Pool> { pool }, spaces); }
+    template<typename C>
+    bool has_component(Id id, Pool pool) const {
+        // {{{ ...
+        return static_cast<bool>(component_ptr<C>(id, pool));
+        // }}}
+    }
 
-    std::string debug_global() const {
+    template<typename C>
+    void remove_component(Id id, Pool pool) {
         // {{{ ...
-        std::stringstream ss;
-        ss << "{ " << _global << " }";
-        return ss.str();
+        check_component<C>();
+
+        size_t idx = pool_index(pool);
+        if (!has_in_pool<C>(id, idx))
+            throw ECSError(std::string("Entity ") + std::to_string(id) + " has no component '" + type_name<C>() + "'.");
+        if (observed<C>()) {
+            notify_remove<C>(id, pool);
+            if (!has_in_pool<C>(id, idx))   // already removed by the observer
+                return;
+        }
+        leave_group_of<C>(id, idx);
+        comp_vec<C>(idx).erase(comp_vec<C>(idx).find(id));
+        touch<C>(idx);
+        record_remove<C>(id);
+        _bits[component_index<C>()].reset(id_index(id));
         // }}}
     }
 
-    std::string debug_all() const {
-        // {{{
-        return std::string("{\n   global = ") + debug_global() + ",\n   entities = " + debug_entities(_pool_set, 3) + "\n}";
+    template<typename C>
+    void check_move(Id id, size_t from, size_t to) const {
+        // {{{ ...
+        if (!PoolTraits::template allows<C>(to) && PoolTraits::template allows<C>(from)
+                && comp_vec<C>(from).find(id) != ComponentVector<C>::npos)
+            throw ECSError(std::string("Component '") + type_name<C>() + "' of entity " + std::to_string(id) + " is not allowed in the destination pool.");
         // }}}
     }
 
-    template <typename... C>
-    std::string debug_entities(size_t spaces=0) const
-    {
+    template<typename C>
+    void move_component(Id id, size_t from, size_t to) {
         // {{{ ...
-        auto entities = find_matching_entities(_pool_set);
-        std::sort(entities.begin(), entities.end());
+        if (!PoolTraits::template allows<C>(from) || !PoolTraits::template allows<C>(to))
+            return;
+        size_t i = comp_vec<C>(from).find(id);
+        if (i != ComponentVector<C>::npos) {
+            comp_vec<C>(from).move_to(i, comp_vec<C>(to));
+            touch<C>(from);
+            touch<C>(to);
+        }
+        // }}}
+    }
 
-        std::string s = "{\n";
-        for (auto const& ent : entities) {
-            bool print = ((ent.template has<C>() || ...));
-            if (print) {
-                s += std::string(spaces, ' ') + std::string("   [");
-                s += std::to_string(ent.id);
-                s += "] = " + ent.debug() + ",\n";
-            }
+    template<typename C>
+    void move_components(std::vector<Id> const& ids, size_t from, size_t to) {
+        // {{{ ...
+        if (PoolTraits::template allows<C>(from) && PoolTraits::template allows<C>(to)) {
+            comp_vec<C>(from).move_to(ids, comp_vec<C>(to));
+            touch<C>(from);
+            touch<C>(to);
         }
-        return s + std::string(spaces, ' ') + "}";
         // }}}
     }
 
-    size_t number_of_entities() const               { return size_to_reserve(_pool_set); }
-    size_t number_of_components() const             { return std::tuple_size<ComponentTupleVector>::value; }
-    size_t number_of_message_types() const {
+    template<typename C>
+    void erase_component(Id id, size_t pool_idx) {
         // {{{ ...
-        if constexpr (std::is_same<Message, NoMessageQueue>::value)
-            return 0;
-        return std::variant_size_v<Message>;
+        if (!has_in_pool<C>(id, pool_idx))
+            return;
+        if (observed<C>()) {
+            notify_remove<C>(id, pool_at(pool_idx));
+            if (!has_in_pool<C>(id, pool_idx))   // already removed by the observer
+                return;
+        }
+        leave_group_of<C>(id, pool_idx);
+        comp_vec<C>(pool_idx).erase(comp_vec<C>(pool_idx).find(id));
+        touch<C>(pool_idx);
+        record_remove<C>(id);
+        _bits[component_index<C>()].reset(id_index(id));
         // }}}
     }
-    size_t message_queue_size() const               { return _messages.size(); }
 
-private:
+    // the pool in slot `pool_idx` must accept the component
+    template <typename C>
+    ComponentVector<C>& comp_vec(size_t pool_idx) {
+        // {{{ ...
+        return const_cast<ComponentVector<C>&>(static_cast<MyECS const*>(this)->comp_vec<C>(pool_idx));
+    }
 
-    // {{{ templates & static assertions
+    template <typename C>
+    ComponentVector<C> const& comp_vec(size_t pool_idx) const {
+        if constexpr (PoolTraits::fixed)
+            return std::get<ComponentPools<C>>(_components)[component_slots<C>()[pool_idx]];
+        else
+            return std::get<ComponentPools<C>>(_components)[pool_idx];
+        // }}}
+    }
 
-#if __cplusplus < 201703L
-#error "A compiler with C++17 support is required."
-#endif
+    // }}}
 
-    // create a tuple from the component list
+    // {{{ private methods (versions)
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-value"
+    template <typename C>
+    void touch(size_t idx)                  { _pools[idx].versions[component_index<C>()] = ++_version; }
+
+    void touch_entities(size_t idx)         { _pools[idx].versions[sizeof...(Components)] = ++_version; }
 
-    using ComponentTupleVector = typename std::tuple<std::vector<std::pair<size_t, Components>>...>;
-    static_assert(std::tuple_size<ComponentTupleVector>::value > 0, "Add at least one component.");
+    // were the components (or the entity list, when there are no components) changed after `version`?
+    template <typename... C>
+    bool changed_since(PoolRange pools, uint64_t version) const {
+        for (size_t idx = pools.first; idx < pools.last; ++idx) {
+            auto const& versions = _pools[idx].versions;
+            if constexpr (sizeof...(C) == 0) {
+                if (versions[sizeof...(Components)] > version)
+                    return true;
+            } else {
+                if (((versions[component_index<filter_component_t<C>>()] > version) || ...))
+                    return true;
+            }
+        }
+        return false;
+    }
 
-    static_assert((std::is_copy_constructible<Components>::value, ...), "All components must be copyable.");
+    // }}}
 
-    template <typename>      struct is_std_variant : std::false_type {};
-    template <typename... T> struct is_std_variant<std::variant<T...>> : std::true_type {};
-    static_assert(is_std_variant<Message>::value, "Message must be a std::variant<...>.");
+    // {{{ private methods (change ticks)
 
-#pragma GCC diagnostic pop
+    template <typename C>
+    void record_add([[maybe_unused]] Id id) {
+        if constexpr (track_changes<C>::value)
+            _ticks[component_index<C>()].add(id_index(id), _tick);
+    }
 
-    // check if component is on the list
     template <typename C>
-    void check_component() const {
-        static_assert((std::is_same_v<C, Components> || ...), "This component is not part of the component list given in the Engine initialization.");
+    void record_change([[maybe_unused]] Id id) {
+        if constexpr (track_changes<C>::value)
+            _ticks[component_index<C>()].change(id_index(id), _tick);
     }
 
-    // check if pool is an enum
-    static_assert(std::is_enum_v<Pool>, "Pool must be an enum.");
+    template <typename C>
+    void record_remove([[maybe_unused]] Id id) {
+        if constexpr (track_changes<C>::value)
+            _ticks[component_index<C>()].remove(id, _tick);
+    }
+
+    template <typename F>
+    ChangeTicks<Id> const* ticks_of() const {
+        using C = filter_component_t<F>;
+        if constexpr (filter_traits<F>::change != ChangeFilter::None) {
+            static_assert(track_changes<C>::value, "The changes of this component are not tracked (see `track_changes`).");
+            return &_ticks[component_index<C>()];
+        }
+        return nullptr;
+    }
+
+    // the tick of the last run of the running system is used by the change filters; the changes made
+    // by a system are not seen by itself in its next run (the systems of `run_mt` run at the same time,
+    // so the ticks are locked)
+    void start_system_ticks() const {
+        std::lock_guard<std::mutex> lock(_system_ticks_mutex);
+        _last_run = _system_ticks[static_cast<size_t>(_current_system)];
+    }
+
+    void end_system_ticks() const {
+        std::lock_guard<std::mutex> lock(_system_ticks_mutex);
+        _system_ticks[static_cast<size_t>(_current_system)] = _tick++;
+        _last_run = 0;
+    }
 
     // }}}
 
-    // {{{ private methods (iteration)
+    // {{{ private methods (observers)
 
-    // type aliases
     template <typename C>
-    using my_iter = typename std::vector<std::pair<size_t, C>>::iterator;
+    Observers<C>& observers()               { return std::get<Observers<C>>(_observers); }
 
     template <typename C>
-    using my_citer = typename std::vector<std::pair<size_t, C>>::const_iterator;
+    Observers<C> const& observers() const   { return std::get<Observers<C>>(_observers); }
 
-    template <typename Pools>
-    size_t size_to_reserve(Pools const& pools) const {
-        size_t size = 0;
-        for (auto const& pool: pools)
-            try {
-                size += _entity_pools.at(pool).size();
-            } catch (std::out_of_range&) {}
-        return size;
+    template <typename C>
+    bool observed() const {
+        if constexpr (observe<C>::value) {
+            auto const& o = observers<C>();
+            return !o.on_add.empty() || !o.on_remove.empty() || !o.on_add_batch.empty() || !o.on_remove_batch.empty();
+        }
+        return false;
     }
 
-    // TODO - the methods below are repeated for const and non-const. Can this be fixed?
+    template <typename C>
+    void notify_add(Id id, Pool pool) {
+        auto& o = observers<C>();
+        if (!o.on_add_batch.empty())
+            o.added.push_back(id);
+        for (size_t i = 0; i < o.on_add.size(); ++i) {   // the observers might register other observers
+            EntityType entity(id, pool, this);
+            o.on_add[i](entity);
+        }
+    }
 
-    template <typename Pools>
-    std::vector<ConstEntity<ECS, Pool>> find_matching_entities(Pools const& pools) const {
-        // {{{ ...
-        size_t size = size_to_reserve(pools);
-        if (size == 0)
-            return {};
-        std::vector<ConstEntity<ECS, Pool>> entities;
-        entities.reserve(size);
-        for (auto const& pool: pools)
-            for (auto [id,_]: _entity_pools.at(pool))
-                entities.emplace_back(id, pool, this);
-        return entities;
-        // }}}
+    template <typename C>
+    void notify_remove(Id id, Pool pool) {
+        auto& o = observers<C>();
+        if (!o.on_remove_batch.empty())
+            o.removed.push_back(id);
+        for (size_t i = 0; i < o.on_remove.size(); ++i) {
+            EntityType entity(id, pool, this);
+            o.on_remove[i](entity);
+        }
     }
 
-    template <typename Pools>
-    std::vector<Entity<ECS, Pool>> find_matching_entities(Pools const& pools) {
-        // {{{ ...
-        size_t size = size_to_reserve(pools);
-        if (size == 0)
-            return {};
-        std::vector<Entity<ECS, Pool>> entities;
-        entities.reserve(size);
-        for (auto const& pool: pools)
-            for (auto [id,_]: _entity_pools.at(pool))
-                entities.emplace_back(id, pool, this);
-        return entities;
-        // }}}
+    // called before the components of a pool are cleared
+    template <typename C>
+    void clearing_components(size_t idx) {
+        if (!PoolTraits::template allows<C>(idx))
+            return;
+        if (track_changes<C>::value || observed<C>()) {
+            std::vector<Id> ids = comp_vec<C>(idx).ids();
+            for (Id id: ids) {
+                if (observed<C>())
+                    notify_remove<C>(id, pool_at(idx));
+                record_remove<C>(id);
+            }
+        }
+
+        auto& bits = _bits[component_index<C>()];
+        if (_pools[idx].entities.size() == _entities.size())
+            bits.clear();
+        else
+            for (Id id: comp_vec<C>(idx).ids())
+                bits.reset(id_index(id));
     }
 
-    // TODO - the methods below are repeated for const and non-const. Can this be fixed?
+    template <typename C>
+    void flush_observers_of() {
+        if constexpr (!observe<C>::value)
+            return;
+        auto& o = observers<C>();
+        if (!o.added.empty()) {
+            std::vector<Id> ids = std::move(o.added);
+            o.added.clear();
+            for (size_t i = 0; i < o.on_add_batch.size(); ++i)
+                o.on_add_batch[i](ids);
+        }
+        if (!o.removed.empty()) {
+            std::vector<Id> ids = std::move(o.removed);
+            o.removed.clear();
+            for (size_t i = 0; i < o.on_remove_batch.size(); ++i)
+                o.on_remove_batch[i](ids);
+        }
+    }
 
-    template <typename... C, typename Pools>
-    std::vector<Entity<ECS, Pool>> find_matching_entities_component(Pools const& pools) {
-        // {{{ ...
-        ((check_component<C>(), ...));
+    // }}}
 
-        size_t size = size_to_reserve(pools);
-        if (size == 0)
-            return {};
-        std::vector<Entity<ECS, Pool>> entities;
-        entities.reserve(size);
-        for (auto const& pool: pools) {
-            if constexpr (sizeof...(C) == 0) {
-                for (auto [id,_]: _entity_pools.at(pool))
-                    entities.emplace_back(id, pool, this);
-            } else {
-                // initialize a tuple of iterators, each one pointing to the initial iterator of its component vector
-                std::tuple<my_iter<C>...> current;
-                ((std::get<my_iter<C>>(current) = comp_vec<C>(pool).begin()), ...);
-
-                // while none of the iterators reached end
-                while (((std::get<my_iter<C>>(current) != comp_vec<C>(pool).end()) && ...)) {
-                    // find iterator that is more advanced
-                    std::vector<size_t> entities1 { std::get<my_iter<C>>(current)->first... };
-                    [[maybe_unused]] size_t last = *std::max_element(entities1.begin(), entities1.end());
-
-                    // advance all iterators that are behind the latest one
-                    (((std::get<my_iter<C>>(current)->first < last) ? std::get<my_iter<C>>(current)++ : std::get<my_iter<C>>(current)), ...);
-                    if (((std::get<my_iter<C>>(current) == comp_vec<C>(pool).end()) || ...))
-                        break;
+    // {{{ private methods (groups)
 
-                    // if all iterators are equal, call user function and advance all iterators
-                    std::vector<size_t> entities2 { std::get<my_iter<C>>(current)->first... };
-                    if (std::adjacent_find(entities2.begin(), entities2.end(), std::not_equal_to<size_t>()) == entities2.end()) {
-                        entities.emplace_back(entities2.at(0), pool, this);
-                        (std::get<my_iter<C>>(current)++, ...);
-                    }
-                }
-            }
-        }
-        return entities;
-        // }}}
+    template <typename S, typename = void>
+    struct has_group_order : std::false_type {};
+
+    template <typename S>
+    struct has_group_order<S, std::void_t<decltype(std::declval<S&>().enter_group(0))>> : std::true_type {};
+
+    template <typename C>
+    static constexpr bool groupable = has_group_order<ComponentVector<C>>::value;
+
+    template <typename C>
+    static constexpr size_t component_index() {
+        constexpr bool same[] = { std::is_same_v<C, Components>... };
+        size_t i = 0;
+        while (!same[i])
+            ++i;
+        return i;
     }
 
-    template <typename... C, typename Pools>
-    std::vector<ConstEntity<ECS, Pool>> find_matching_entities_component(Pools const& pools) const {
-        // {{{ ...
-        ((check_component<C>(), ...));
+    // the group (starting at 1) that owns the component, or 0
+    template <typename C>
+    size_t group_of() const                 { return _group_of[component_index<C>()]; }
 
-        size_t size = size_to_reserve(pools);
-        if (size == 0)
-            return {};
-        std::vector<ConstEntity<ECS, Pool>> entities;
-        entities.reserve(size);
-        for (auto const& pool: pools) {
-            if constexpr (sizeof...(C) == 0) {
-                for (auto [id,_]: _entity_pools.at(pool))
-                    entities.emplace_back(id, pool, this);
-            } else {
-                // initialize a tuple of iterators, each one pointing to the initial iterator of its component vector
-                std::tuple<my_citer<C>...> current;
-                ((std::get<my_citer<C>>(current) = comp_vec<C>(pool).cbegin()), ...);
-
-                // while none of the iterators reached cend
-                while (((std::get<my_citer<C>>(current) != comp_vec<C>(pool).cend()) && ...)) {
-                    // find iterator that is more advanced
-                    std::vector<size_t> entities1 { std::get<my_citer<C>>(current)->first... };
-                    [[maybe_unused]] size_t last = *std::max_element(entities1.cbegin(), entities1.cend());
-
-                    // advance all iterators that are behind the latest one
-                    (((std::get<my_citer<C>>(current)->first < last) ? std::get<my_citer<C>>(current)++ : std::get<my_citer<C>>(current)), ...);
-                    if (((std::get<my_citer<C>>(current) == comp_vec<C>(pool).cend()) || ...))
-                        break;
+    bool group_has_all(size_t g, Id id, size_t idx) const {
+        return ((group_of<Components>() != g || has_in_pool<Components>(id, idx)) && ...);
+    }
 
-                    // if all iterators are equal, call user function and advance all iterators
-                    std::vector<size_t> entities2 { std::get<my_citer<C>>(current)->first... };
-                    if (std::adjacent_find(entities2.cbegin(), entities2.cend(), std::not_equal_to<size_t>()) == entities2.cend()) {
-                        entities.emplace_back(entities2.at(0), pool, this);
-                        (std::get<my_citer<C>>(current)++, ...);
-                    }
-                }
-            }
+    bool in_group(size_t g, Id id, size_t idx) const {
+        return ((group_of<Components>() == g && in_group_order<Components>(id, idx)) || ...);
+    }
+
+    template <typename C>
+    bool has_in_pool(Id id, size_t idx) const {
+        return PoolTraits::template allows<C>(idx) && comp_vec<C>(idx).find(id) != ComponentVector<C>::npos;
+    }
+
+    template <typename C>
+    bool in_group_order(Id id, size_t idx) const {
+        if (!PoolTraits::template allows<C>(idx))
+            return false;
+        size_t i = comp_vec<C>(idx).find(id);
+        return i != ComponentVector<C>::npos && i < comp_vec<C>(idx).group_size();
+    }
+
+    void enter_group(size_t g, Id id, size_t idx) {
+        ((group_of<Components>() == g ? move_group_order<Components>(id, idx, true) : void()), ...);
+    }
+
+    void leave_group(size_t g, Id id, size_t idx) {
+        ((group_of<Components>() == g ? move_group_order<Components>(id, idx, false) : void()), ...);
+    }
+
+    template <typename C>
+    void move_group_order([[maybe_unused]] Id id, [[maybe_unused]] size_t idx, [[maybe_unused]] bool enter) {
+        if constexpr (groupable<C>) {
+            auto& storage = comp_vec<C>(idx);
+            if (enter)
+                storage.enter_group(storage.find(id));
+            else
+                storage.leave_group(storage.find(id));
         }
-        return entities;
-        // }}}
+    }
+
+    // called before a component of the entity is removed
+    template <typename C>
+    void leave_group_of(Id id, size_t idx) {
+        size_t g = group_of<C>();
+        if (g != 0 && in_group(g, id, idx))
+            leave_group(g, id, idx);
+    }
+
+    // called after a component is added to the entity
+    template <typename C>
+    void enter_group_of(Id id, size_t idx) {
+        size_t g = group_of<C>();
+        if (g != 0 && group_has_all(g, id, idx))
+            enter_group(g, id, idx);
+    }
+
+    // called when the entity changes pools
+    void leave_groups(Id id, size_t idx) {
+        for (size_t g = 1; g <= _group_sizes.size(); ++g)
+            if (in_group(g, id, idx))
+                leave_group(g, id, idx);
+    }
+
+    void enter_groups(Id id, size_t idx) {
+        for (size_t g = 1; g <= _group_sizes.size(); ++g)
+            if (group_has_all(g, id, idx))
+                enter_group(g, id, idx);
     }
 
     // }}}
 
-    // {{{ private methods (components)
+    // {{{ private methods (entity directory)
 
-    template<typename C, typename... P>
-    C& add_component(size_t id, Pool pool, P&& ...pars) {
+    Entity<MyECS, Pool> add_entity(Pool pool, size_t pool_idx) {
         // {{{ ...
-        check_component<C>();
+        Id id = new_entity_id(pool_idx);
+        _pools[pool_idx].entities.insert(id);
+        touch_entities(pool_idx);
+
+        uint32_t slot;
+        if (_free_slots.empty()) {
+            if (_slots.size() == std::numeric_limits<uint32_t>::max())
+                throw ECSError("Too many entities.");
+            slot = static_cast<uint32_t>(_slots.size());
+            _slots.push_back({ id, pool, 0, true });
+        } else {
+            slot = _free_slots.back();
+            _free_slots.pop_back();
+            _slots[slot].id = id;
+            _slots[slot].pool = pool;
+            _slots[slot].alive = true;
+        }
+        _entities.emplace(id, slot);
 
-        auto& vec = comp_vec<C>(pool);
-        auto it = std::lower_bound(begin(vec), end(vec), id,
-                                   [](auto const& p, auto e) { return p.first < e; });
+        return Entity<MyECS, Pool>(id, pool, this);
+        // }}}
+    }
 
-        if (it != vec.end() && it->first == id)
-            throw ECSError(std::string("Component '") + type_name<C>() + "' already exist for entity " + std::to_string(id) + ".");
+    void release_slot(uint32_t slot) {
+        ++_slots[slot].generation;
+        _slots[slot].alive = false;
+        _free_slots.push_back(slot);
+    }
 
-        return vec.emplace(it, id, C { pars... })->second;
-        // }}}
+    EntitySlot const& handle_slot(EntityHandle h) const {
+        if (!valid(h))
+            throw ECSError("Invalid entity handle.");
+        return _slots[h.index];
     }
 
-    template<typename C>
-    C& component(size_t id, Pool pool) {
-        // {{{ ...
-        return const_cast<C&>(static_cast<MyECS const*>(this)->component<C>(id, pool));
+    // when the pool is encoded in the id, the highest bits of the id hold the pool slot
+    static constexpr size_t bit_width(size_t n) { return n == 0 ? 0 : 1 + bit_width(n >> 1); }
+    static constexpr size_t PoolIdBits  = PoolTraits::pool_in_id ? bit_width(DefaultPoolIndex) : 0;
+    static constexpr size_t PoolIdShift = std::numeric_limits<Id>::digits - PoolIdBits;
+
+    // the id without the pool, that indexes the bitsets and the change ticks
+    static size_t id_index(Id id) {
+        if constexpr (PoolTraits::pool_in_id)
+            return static_cast<size_t>(id & ((Id(1) << PoolIdShift) - 1));
+        else
+            return static_cast<size_t>(id);
     }
 
-    template<typename C>
-    C const& component(size_t id, Pool pool) const {
-        C const* c = component_ptr<C>(id, pool);
-        if (c == nullptr)
-            throw ECSError(std::string("Entity ") + std::to_string(id) + " has no component '" + type_name<C>() + "'.");
-        return *c;
+    // the id of an index in a pool (the highest id for npos)
+    static Id id_at(size_t index, [[maybe_unused]] size_t pool_idx) {
+        if (index == IdBitset::npos)
+            return std::numeric_limits<Id>::max();
+        if constexpr (PoolTraits::pool_in_id)
+            return static_cast<Id>(index) | static_cast<Id>(static_cast<Id>(pool_idx) << PoolIdShift);
+        else
+            return static_cast<Id>(index);
+    }
+
+    Id new_entity_id([[maybe_unused]] size_t pool_idx) {
+        // {{{ ...
+        if constexpr (PoolTraits::pool_in_id) {
+            if ((_next_entity_id >> PoolIdShift) != 0)
+                throw ECSError("No more entity ids available.");
+            return _next_entity_id++ | static_cast<Id>(static_cast<Id>(pool_idx) << PoolIdShift);
+        } else {
+            if (_next_entity_id == std::numeric_limits<Id>::max())
+                throw ECSError("No more entity ids available.");
+            return _next_entity_id++;
+        }
         // }}}
     }
 
-    template<typename C>
-    C* component_ptr(size_t id, Pool pool) {
+    Pool pool_of(Id id) const {
         // {{{ ...
-        return const_cast<C*>(static_cast<MyECS const*>(this)->component_ptr<C>(id, pool));
+        if constexpr (PoolTraits::pool_in_id) {
+            size_t idx = static_cast<size_t>(id >> PoolIdShift);
+            if (idx > DefaultPoolIndex)
+                throw ECSError("Id " + std::to_string(id) + " not found.");
+            return pool_at(idx);
+        } else {
+            auto it = _entities.find(id);
+            if (it == _entities.end())
+                throw ECSError("Id " + std::to_string(id) + " not found.");
+            return _slots[it->second].pool;
+        }
+        // }}}
     }
 
-    template<typename C>
-    C const* component_ptr(size_t id, Pool pool) const {
-        check_component<C>();
+    // }}}
 
-        auto& vec = comp_vec<C>(pool);
-        auto it = std::lower_bound(begin(vec), end(vec), id,
-                                   [](auto const& p, size_t e) { return p.first < e; });
-        if (it != vec.end() && it->first == id)
-            return &it->second;
-        return nullptr;
+    // {{{ private methods (pools)
+
+    size_t pool_index(Pool pool) const {
+        // {{{ ...
+        if constexpr (PoolTraits::fixed) {
+            return pool == DefaultPool ? DefaultPoolIndex : static_cast<size_t>(pool);
+        } else {
+            auto it = std::find(_pool_keys.begin(), _pool_keys.end(), pool);
+            return it == _pool_keys.end() ? NoPoolIndex : static_cast<size_t>(it - _pool_keys.begin());
+        }
         // }}}
     }
 
-    template<typename C>
-    bool has_component(size_t id, Pool pool) const {
+    size_t checked_pool_index(Pool pool) const {
         // {{{ ...
-        return component_ptr<C>(id, pool) != nullptr;
+        size_t idx = pool_index(pool);
+        if constexpr (PoolTraits::fixed)
+            if (idx > DefaultPoolIndex)
+                throw ECSError("Pool " + std::to_string(idx) + " is out of range.");
+        return idx;
         // }}}
     }
 
-    template<typename C>
-    void remove_component(size_t id, Pool pool) {
+    size_t register_pool(Pool pool) {
         // {{{ ...
-        check_component<C>();
-
-        auto& vec = comp_vec<C>(pool);
-        auto it = std::lower_bound(begin(vec), end(vec), id,
-                                   [](auto const& p, size_t e) { return p.first < e; });
-        if (it != vec.end() && it->first == id)
-            vec.erase(it);
-        else
-            throw ECSError(std::string("Entity ") + std::to_string(id) + " has no component '" + type_name<C>() + "'.");
+        size_t idx = checked_pool_index(pool);
+        if constexpr (!PoolTraits::fixed) {
+            if (idx == NoPoolIndex) {
+                _pool_keys.push_back(pool);
+                _pools.emplace_back();
+                (std::get<ComponentPools<Components>>(_components).emplace_back(), ...);
+                idx = _pools.size() - 1;
+            }
+        }
+        return idx;
         // }}}
     }
 
-    template <typename C>
-    std::vector<std::pair<size_t, C>>& comp_vec(Pool pool) {
+    Pool pool_at(size_t idx) const {
         // {{{ ...
-        return std::get<std::vector<std::pair<size_t, C>>>(_components.at(pool));
+        if constexpr (PoolTraits::fixed)
+            return idx == DefaultPoolIndex ? DefaultPool : static_cast<Pool>(idx);
+        else
+            return _pool_keys[idx];
+        // }}}
     }
 
-    template <typename C>
-    std::vector<std::pair<size_t, C>> const& comp_vec(Pool pool) const {
-        return std::get<std::vector<std::pair<size_t, C>>>(_components.at(pool));
-        // }}}
+    PoolRange all_pools() const             { return { 0, _pools.size() }; }
+
+    PoolRange single_pool(Pool pool) const {
+        size_t idx = checked_pool_index(pool);
+        return idx == NoPoolIndex ? PoolRange { 0, 0 } : PoolRange { idx, idx + 1 };
     }
 
     // }}}
@@ -934,24 +3756,23 @@ private:
     // {{{ private methods (debugging)
 
     template <typename C>
-    std::string debug_component(size_t id) const
+    std::string debug_component(Id id) const
     {
         check_component<C>();
         return "{ " + debug_object<C>(component<C>(id)) + "}";
     }
 
-    std::string debug_entity(size_t id, Pool pool, size_t spaces=0) const
+    std::string debug_entity(Id id, Pool pool, size_t spaces=0) const
     {
         std::string s = std::string(spaces, ' ') + "{\n";
-        ((s += has_component<Components>(id, pool) ? (std::string(6, ' ') + debug_object<Components>(component<Components>(id, pool)) + "\n") : ""), ...);
+        ((s += has_component<Components>(id, pool) ? (std::string(6, ' ') + debug_object(component<Components>(id, pool)) + "\n") : ""), ...);
         return s + std::string(3, ' ') + "}";
     }
 
-    template <typename T>
-    std::string debug_entities(T const& pools, size_t spaces=0) const
+    std::string debug_entities(PoolRange pools, size_t spaces=0) const
     {
         // {{{ ...
-        auto entities = find_matching_entities(pools);
+        auto entities = find_matching_entities<ConstEntityType>(pools);
         std::sort(entities.begin(), entities.end());
 
         std::string s = "{\n";
@@ -968,27 +3789,54 @@ private:
 
     // {{{ private data
 
-    using EntityPool = std::unordered_map<size_t, Pool>;
-
     Global                                             _global;
     Threading                                          _threading           = Threading::Multi;
     mutable SyncQueue<Message>                         _messages            {};
-    std::unordered_map<size_t, Pool>                   _entities            {};
-    std::unordered_map<Pool, EntityPool>               _entity_pools        { { DefaultPool, {} } };
-    std::unordered_map<Pool, ComponentTupleVector>     _components          { { DefaultPool, {} } };
-    size_t                                             _next_entity_id      = 0;
-    std::set<Pool>                                     _pool_set            { DefaultPool };
+    std::unordered_map<Id, uint32_t>                   _entities            {};
+    std::vector<EntitySlot>                            _slots               {};
+    std::vector<uint32_t>                              _free_slots          {};
+    PoolContainer                                      _pools               { initial_pools() };
+    ComponentStorage                                   _components          { initial_components() };
+    std::vector<Pool>                                  _pool_keys           { DefaultPool };
+    std::array<size_t, sizeof...(Components)>          _group_of            {};
+    uint64_t                                           _version             = 0;    // incremented when the components or entities change
+    std::array<ChangeTicks<Id>, sizeof...(Components)> _ticks               {};
+    mutable std::atomic<uint64_t>                      _tick                { 1 };  // incremented after each system runs
+    mutable std::vector<uint64_t>                      _system_ticks        {};     // the tick of the last run of each system
+    mutable std::mutex                                 _system_ticks_mutex  {};
+    std::tuple<Observers<Components>...>               _observers           {};
+    std::array<IdBitset, sizeof...(Components)>        _bits                {};     // the ids that have each component
+    std::vector<size_t>                                _group_sizes         {};
+    Id                                                 _next_entity_id      = 0;
     bool                                               _running_mt          = false;
     mutable Timer                                      _timer               {};
     mutable std::vector<std::thread>                   _threads             {};
     mutable std::unordered_map<std::string, SystemPtr> _system_idx          {};
 
     static inline thread_local SystemPtr               _current_system      = -1;
-    static constexpr Pool DefaultPool = static_cast<Pool>(std::numeric_limits<typename std::underlying_type<Pool>::type>::max());
+    static inline thread_local uint64_t                _last_run            = 0;    // of the running system
+
+    static PoolContainer initial_pools() {
+        if constexpr (PoolTraits::fixed)
+            return {};
+        else
+            return PoolContainer(1);
+    }
+
+    static ComponentStorage initial_components() {
+        if constexpr (PoolTraits::fixed)
+            return {};
+        else
+            return ComponentStorage { ComponentPools<Components>(1)... };
+    }
 
     // }}}
 };
 
+// The entity ids are `size_t`. Use `BasicECS<Id, ...>` to choose another id type, such as `uint32_t`.
+template <typename Global, typename Message, typename Pool, typename... Components>
+using ECS = BasicECS<size_t, Global, Message, Pool, Components...>;
+
 }
 
 #endif
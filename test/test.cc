@@ -1,5 +1,8 @@
 #include "fastecs.hh"
 
+#include <memory>
+#include <sstream>
+
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
 
@@ -30,6 +33,22 @@ struct MessageTypeA { size_t id; };
 struct MessageTypeB { string abc; };
 using Message = variant<MessageTypeA, MessageTypeB>;
 
+// the ids of a list of entities, in the same order
+template <typename Entities>
+std::vector<size_t> ids(Entities const& entities) {
+    std::vector<size_t> r;
+    for (auto const& e: entities)
+        r.push_back(e.id);
+    return r;
+}
+
+template <typename Entities>
+std::vector<size_t> sorted_ids(Entities const& entities) {
+    std::vector<size_t> r = ids(entities);
+    std::sort(r.begin(), r.end());
+    return r;
+}
+
 // }}}
 
 TEST_CASE("entities") { 
@@ -166,6 +185,1147 @@ TEST_CASE("iterate components") {
     // }}}
 }
 
+TEST_CASE("pool migration") {
+    // {{{ ...
+
+    enum class Pool { Active, Dormant };
+    ECS<NoGlobal, NoMessageQueue, Pool, Position, Direction> ecs;
+
+    Entity e1 = ecs.add(Pool::Active);
+    e1.add<Position>(1, 2);
+    e1.add<Direction>("N");
+
+    Entity e2 = ecs.add(Pool::Active);
+    e2.add<Position>(3, 4);
+
+    Entity e3 = ecs.add(Pool::Active);
+    e3.add<Direction>("S");
+
+    // single entity
+    auto m1 = ecs.move_to_pool(e1, Pool::Dormant);
+    CHECK(m1.id == e1.id);
+    CHECK(m1.pool == Pool::Dormant);
+    CHECK(m1.get<Position>().x == 1);
+    CHECK(m1.get<Direction>().dir == "N");
+    CHECK(ecs.entities(Pool::Active).size() == 2);
+    CHECK(ecs.entities<Position>(Pool::Active).size() == 1);
+    CHECK(ecs.entities<Position, Direction>(Pool::Dormant).size() == 1);
+    CHECK(ecs.get(e1.id).pool == Pool::Dormant);
+
+    // batch
+    auto moved = ecs.move_many(std::vector<decltype(e1)> { e3, e2 }, Pool::Dormant);
+    CHECK(moved.size() == 2);
+    CHECK(ecs.entities(Pool::Active).empty());
+    CHECK(ecs.entities(Pool::Dormant).size() == 3);
+    CHECK(ecs.get(e2.id).get<Position>().y == 4);
+    CHECK(ecs.get(e3.id).get<Direction>().dir == "S");
+
+    // components remain sorted, so they can still be iterated in order
+    auto with_pos = ecs.entities<Position>(Pool::Dormant);
+    REQUIRE(with_pos.size() == 2);
+    CHECK(with_pos.at(0) == e1);
+    CHECK(with_pos.at(1) == e2);
+
+    // the components of the entities that don't move are kept
+    Entity e4 = ecs.add(Pool::Active);
+    e4.add<Direction>("W");
+    Entity e5 = ecs.add(Pool::Active);
+    e5.add<Position>(5, 6);
+    ecs.move_many(std::vector<decltype(e1)> { e5 }, Pool::Dormant);
+    CHECK(e4.get<Direction>().dir == "W");
+    CHECK(ecs.get(e5.id).get<Position>().x == 5);
+
+    // }}}
+}
+
+TEST_CASE("clear pool") {
+    // {{{ ...
+
+    enum class Pool { Particles };
+    ECS<NoGlobal, NoMessageQueue, Pool, Position, Direction> ecs;
+
+    Entity e1 = ecs.add();
+    e1.add<Position>(1, 1);
+
+    for (int i = 0; i < 10; ++i)
+        ecs.add(Pool::Particles).add<Position>(i, i);
+    CHECK(ecs.entities<Position>().size() == 11);
+
+    ecs.clear_pool(Pool::Particles);
+    CHECK(ecs.number_of_entities() == 1);
+    CHECK(ecs.entities(Pool::Particles).empty());
+    CHECK(ecs.entities<Position>().size() == 1);
+    CHECK(ecs.exists(e1.id));
+    CHECK(!ecs.exists(e1.id + 1));
+
+    // the pool can be reused
+    Entity e2 = ecs.add(Pool::Particles);
+    e2.add<Direction>("W");
+    CHECK(ecs.entities<Direction>(Pool::Particles).size() == 1);
+
+    // removing an entity also removes its components
+    ecs.remove(e1);
+    CHECK(ecs.entities<Position>().empty());
+
+    // }}}
+}
+
+TEST_CASE("fixed pools") {
+    // {{{ ...
+
+    enum class Pool { Units, Particles };
+    ECS<NoGlobal, NoMessageQueue, Pools<Pool, 2>, Position, Direction> ecs;
+
+    Entity e1 = ecs.add();
+    e1.add<Position>(1, 1);
+    Entity e2 = ecs.add(Pool::Units);
+    e2.add<Position>(2, 2);
+    Entity e3 = ecs.add(Pool::Particles);
+    e3.add<Position>(3, 3);
+    e3.add<Direction>("E");
+
+    CHECK(ecs.entities().size() == 3);
+    CHECK(ecs.entities<Position>().size() == 3);
+    CHECK(ecs.entities<Position>(Pool::Units).size() == 1);
+    CHECK(ecs.entities<Position, Direction>(Pool::Particles).at(0) == e3);
+    CHECK(ecs.get(e2.id).pool == Pool::Units);
+    CHECK(e3.get<Direction>().dir == "E");
+
+    ecs.move_to_pool(e1, Pool::Units);
+    CHECK(ecs.entities<Position>(Pool::Units).size() == 2);
+
+    CHECK_THROWS_AS(ecs.add(static_cast<Pool>(5)), ECSError);
+
+    // }}}
+}
+
+TEST_CASE("pool components") {
+    // {{{ ...
+
+    enum class Pool { Units, Particles };
+    using MyPools = Pools<Pool, 2, PoolComponents<Pool::Particles, Position>>;
+    ECS<NoGlobal, NoMessageQueue, MyPools, Position, Direction> ecs;
+
+    Entity e1 = ecs.add(Pool::Particles);
+    e1.add<Position>(1, 1);
+    CHECK_THROWS_AS(e1.add<Direction>("N"), ECSError);
+    CHECK(!e1.has<Direction>());
+    CHECK(e1.get_ptr<Direction>() == nullptr);
+
+    Entity e2 = ecs.add(Pool::Units);
+    e2.add<Position>(2, 2);
+    e2.add<Direction>("N");
+    CHECK(ecs.entities<Position, Direction>().size() == 1);
+    CHECK(ecs.entities<Direction>(Pool::Particles).empty());
+
+    // entities can only be moved to a pool that accepts all its components
+    CHECK_THROWS_AS(ecs.move_to_pool(e2, Pool::Particles), ECSError);
+    CHECK(ecs.get(e2.id).pool == Pool::Units);
+    CHECK(e2.get<Direction>().dir == "N");
+
+    e2.remove<Direction>();
+    ecs.move_to_pool(e2, Pool::Particles);
+    CHECK(ecs.entities<Position>(Pool::Particles).size() == 2);
+
+    // }}}
+}
+
+TEST_CASE("pool in id") {
+    // {{{ ...
+
+    enum class Pool { Units, Particles };
+    ECS<NoGlobal, NoMessageQueue, Pools<Pool, 2, PoolInId>, Position, Direction> ecs;
+
+    Entity e1 = ecs.add();
+    e1.add<Position>(1, 1);
+    Entity e2 = ecs.add(Pool::Particles);
+    e2.add<Position>(2, 2);
+    Entity e3 = ecs.add(Pool::Units);
+    e3.add<Direction>("N");
+
+    CHECK(e1.id != e2.id);
+    CHECK(e2.id != e3.id);
+    CHECK(ecs.get<Position>(e1.id).x == 1);
+    CHECK(ecs.get<Position>(e2.id).x == 2);
+    CHECK(ecs.get_ptr<Position>(e3.id) == nullptr);
+    CHECK(ecs.has<Direction>(e3.id));
+    CHECK(ecs.get(e2.id).pool == Pool::Particles);
+    CHECK(ecs.entities<Position>(Pool::Particles).at(0) == e2);
+
+    ecs.remove(e2);
+    CHECK(!ecs.exists(e2.id));
+    CHECK_THROWS(ecs.get(e2.id));
+
+    // }}}
+}
+
+TEST_CASE("entity handles") {
+    // {{{ ...
+
+    struct Target { EntityHandle target; };
+    using MyECS = ECS<NoGlobal, NoMessageQueue, NoPool, Position, Target>;
+    MyECS ecs;
+
+    static_assert(sizeof(EntityHandle) == 8);
+    static_assert(sizeof(MyECS::EntityType) < 32);
+
+    Entity e1 = ecs.add();
+    e1.add<Position>(4, 5);
+    Entity e2 = ecs.add();
+    e2.add<Target>(e1.handle());
+
+    EntityHandle h = e2.get<Target>().target;
+    CHECK(ecs.valid(h));
+    CHECK(ecs.get(h) == e1);
+    CHECK(ecs.get<Position>(h).x == 4);
+    CHECK(ecs.get_ptr<Target>(h) == nullptr);
+    CHECK(ecs.has<Position>(h));
+    ecs.get<Position>(h).x = 8;
+    CHECK(e1.get<Position>().x == 8);
+
+    // handles of removed entities become invalid, even if their slot is reused
+    ecs.remove(e1);
+    CHECK(!ecs.valid(h));
+    CHECK_THROWS_AS(ecs.get(h), ECSError);
+    Entity e3 = ecs.add();
+    CHECK(!ecs.valid(h));
+    CHECK(ecs.valid(e3.handle()));
+    CHECK(e3.handle() != h);
+
+    // }}}
+}
+
+TEST_CASE("32-bit entity ids") {
+    // {{{ ...
+
+    struct Speed { float v; };
+    using MyECS = BasicECS<uint32_t, NoGlobal, NoMessageQueue, NoPool, Speed, Direction>;
+    MyECS ecs;
+
+    static_assert(sizeof(MyECS::Id) == 4);
+
+    Entity e1 = ecs.add();
+    Entity e2 = ecs.add();
+    e2.add<Speed>(2.f);
+    e2.add<Direction>("N");
+    e1.add<Speed>(1.f);
+    CHECK(ecs.get<Speed>(e2.id).v == 2.f);
+
+    std::vector<MyECS::Id> ids;
+    for (auto& e: ecs.entities<Speed>())
+        ids.push_back(e.id);
+    CHECK(ids == std::vector<MyECS::Id> { e1.id, e2.id });
+    CHECK(ecs.entities<Speed, Direction>().size() == 1);
+
+    e2.remove<Speed>();
+    CHECK(!e2.has<Speed>());
+    CHECK(ecs.entities<Speed>().size() == 1);
+
+    // }}}
+}
+
+TEST_CASE("move-only components") {
+    // {{{ ...
+
+    enum class Pool { Active, Dormant };
+    struct Owner { std::unique_ptr<int> value; };
+    ECS<NoGlobal, NoMessageQueue, Pools<Pool, 2>, Owner, Position> ecs;
+
+    Entity e1 = ecs.add(),
+           e2 = ecs.add();
+    e2.add<Owner>(std::make_unique<int>(2));
+    e1.add<Owner>(std::make_unique<int>(1));   // inserted before e2
+    CHECK(*e1.get<Owner>().value == 1);
+    CHECK(*e2.get<Owner>().value == 2);
+
+    // components are built in place, not copied
+    std::stringstream ss;
+    auto old_buf = std::cout.rdbuf(ss.rdbuf());
+    e1.add<Position>(1, 2);
+    std::cout.rdbuf(old_buf);
+    CHECK(ss.str().empty());
+
+    Entity e3 = ecs.move_to_pool(e1, Pool::Dormant);
+    CHECK(*e3.get<Owner>().value == 1);
+    e2.remove<Owner>();
+    CHECK(ecs.entities<Owner>().size() == 1);
+
+    // }}}
+}
+
+struct Path { std::vector<int> points; };
+template<> struct ecs::is_trivially_relocatable<Path> : std::true_type {};
+
+TEST_CASE("trivially relocatable components") {
+    // {{{ ...
+
+    static_assert(is_trivially_relocatable<EntityHandle>::value);
+    static_assert(!is_trivially_relocatable<Direction>::value);
+
+    enum class Pool { Active, Dormant };
+    ECS<NoGlobal, NoMessageQueue, Pools<Pool, 2>, Path> ecs;
+
+    std::vector<Entity<decltype(ecs), Pool>> es;
+    for (int i = 0; i < 20; ++i)
+        es.push_back(ecs.add(Pool::Active));
+    for (int i = 19; i >= 0; --i)   // every component is inserted at the beginning
+        es[i].add<Path>(std::vector<int> { i, i * 2 });
+    for (int i = 0; i < 20; ++i)
+        CHECK(es[i].get<Path>().points == std::vector<int> { i, i * 2 });
+
+    es[3].remove<Path>();
+    ecs.move_many(std::vector { es[5], es[10] }, Pool::Dormant);
+    ecs.move_to_pool(es[1], Pool::Dormant);
+    CHECK(ecs.entities<Path>(Pool::Dormant).size() == 3);
+    CHECK(ecs.entities<Path>(Pool::Active).size() == 16);
+    CHECK(ecs.get<Path>(es[10].id).points.at(1) == 20);
+    CHECK(ecs.get<Path>(es[19].id).points.at(1) == 38);
+
+    // a component copied from another entity, when the array shifts or grows
+    es[3].add<Path>(ecs.get<Path>(es[4].id));
+    CHECK(es[3].get<Path>().points == std::vector<int> { 4, 8 });
+    struct Pos { int x, y; };
+    ECS<NoGlobal, NoMessageQueue, NoPool, Pos> pecs;
+    auto p1 = pecs.add();
+    p1.add<Pos>(1, 2);
+    auto p2 = pecs.add();
+    p2.add<Pos>(p1.get<Pos>());
+    CHECK(p2.get<Pos>().y == 2);
+
+    // }}}
+}
+
+struct Polygon { std::vector<int> points; };
+template<> struct ecs::recycle_traits<Polygon> {
+    static constexpr bool enabled = true;
+    static void reset(Polygon& p) { p.points.clear(); }
+};
+
+struct Outline { std::vector<int> points; };
+template<> struct ecs::recycle_traits<Outline> {
+    static constexpr bool enabled = true;
+    static constexpr size_t max_free = 2;
+    static void reset(Outline& o) { o.points.clear(); }
+};
+
+TEST_CASE("component recycling") {
+    // {{{ ...
+
+    ECS<NoGlobal, NoMessageQueue, NoPool, Polygon> ecs;
+
+    Entity e1 = ecs.add();
+    e1.add<Polygon>().points.reserve(100);
+    e1.get<Polygon>().points.push_back(1);
+    e1.remove<Polygon>();
+
+    // the removed component is reused, keeping its capacity
+    Entity e2 = ecs.add();
+    Polygon& p = e2.add<Polygon>();
+    CHECK(p.points.empty());
+    CHECK(p.points.capacity() >= 100);
+
+    // components removed with their entity are also recycled
+    ecs.remove(e2);
+    Entity e3 = ecs.add();
+    CHECK(e3.add<Polygon>().points.capacity() >= 100);
+
+    // there's no `reset` with parameters, so this component is created normally
+    Entity e4 = ecs.add();
+    CHECK(e4.add<Polygon>(std::vector<int> { 1, 2 }).points.size() == 2);
+
+    // the free list keeps at most `max_free` components
+    ECS<NoGlobal, NoMessageQueue, NoPool, Outline> ecs2;
+    for (int i = 0; i < 3; ++i)
+        ecs2.add().add<Outline>().points.reserve(100);
+    for (auto& e: ecs2.entities())
+        ecs2.remove(e);
+    size_t reused = 0;
+    for (int i = 0; i < 3; ++i)
+        reused += ecs2.add().add<Outline>().points.capacity() >= 100 ? 1 : 0;
+    CHECK(reused == 2);
+
+    // the components moved to another pool are not recycled
+    enum class Pool { Active, Dormant };
+    ECS<NoGlobal, NoMessageQueue, Pools<Pool, 2>, Outline> ecs3;
+    auto moving = ecs3.add(Pool::Active);
+    moving.add<Outline>().points.reserve(100);
+    ecs3.move_to_pool(moving, Pool::Dormant);
+    for (int i = 0; i < 2; ++i)
+        ecs3.add(Pool::Active).add<Outline>().points.reserve(100);
+    for (auto& e: ecs3.entities(Pool::Active))
+        ecs3.remove(e);
+    reused = 0;
+    for (int i = 0; i < 2; ++i)
+        reused += ecs3.add(Pool::Active).add<Outline>().points.capacity() >= 100 ? 1 : 0;
+    CHECK(reused == 2);
+
+    // }}}
+}
+
+TEST_CASE("buffers") {
+    // {{{ ...
+
+    struct Path : Buffer<int, 2> {};
+    enum class Pool { Active, Dormant };
+    ECS<NoGlobal, NoMessageQueue, Pools<Pool, 2>, Path> ecs;
+
+    Entity e1 = ecs.add(Pool::Active),
+           e2 = ecs.add(Pool::Active);
+    Path& p1 = e1.add<Path>();
+    p1.push_back(1);
+    p1.push_back(2);
+    CHECK(p1.capacity() == 2);
+    Path& p2 = e2.add<Path>();
+    for (int i = 0; i < 10; ++i)
+        p2.push_back(i);
+    CHECK(p2.size() == 10);
+    CHECK(p2.capacity() > 2);
+    e1.get<Path>().push_back(3);   // moves to the arena
+
+    int sum = 0;
+    for (auto& e: ecs.entities<Path>())
+        for (int v: e.get<Path>())
+            sum += v;
+    CHECK(sum == 6 + 45);
+
+    // moving to another pool moves the elements to the other arena
+    Entity e3 = ecs.move_to_pool(e2, Pool::Dormant);
+    CHECK(e3.get<Path>()[9] == 9);
+    e1.remove<Path>();   // compacts the arena
+    CHECK(e3.get<Path>().size() == 10);
+    CHECK(e3.get<Path>()[5] == 5);
+
+    // an element of the buffer can be added to it, even if it reallocates
+    Path& p3 = e3.get<Path>();
+    while (p3.size() < p3.capacity())
+        p3.push_back(7);
+    p3.push_back(p3[9]);
+    CHECK(p3[p3.size() - 1] == 9);
+
+    // the growing buffers reuse the memory released by the others
+    Entity e4 = ecs.add(Pool::Dormant);
+    Path& p4 = e4.add<Path>();
+    for (int i = 0; i < 40; ++i)
+        p4.push_back(i);
+    CHECK(p4[39] == 39);
+    CHECK(ecs.get<Path>(e3.id)[9] == 9);
+
+    // }}}
+}
+
+struct UnitStats {
+    int hp, speed;
+    bool operator==(UnitStats const& o) const { return hp == o.hp && speed == o.speed; }
+};
+
+TEST_CASE("shared components") {
+    // {{{ ...
+
+    enum class Pool { Active, Dormant };
+    ECS<NoGlobal, NoMessageQueue, Pools<Pool, 2>, Shared<UnitStats>, Shared<std::string>> ecs;
+
+    Entity e1 = ecs.add(Pool::Active),
+           e2 = ecs.add(Pool::Active),
+           e3 = ecs.add(Pool::Active);
+    e1.add<Shared<UnitStats>>(10, 2);
+    e2.add<Shared<UnitStats>>(10, 2);
+    e3.add<Shared<UnitStats>>(20, 1);
+
+    // identical values are stored only once
+    UnitStats const& s1 = e1.get<Shared<UnitStats>>();
+    CHECK(&s1 == &e2.get<Shared<UnitStats>>());
+    CHECK(&s1 != &e3.get<Shared<UnitStats>>());
+    CHECK(e3.get<Shared<UnitStats>>().hp == 20);
+    CHECK(ecs.entities<Shared<UnitStats>>().size() == 3);
+
+    // values with std::hash
+    e1.add<Shared<std::string>>("orc");
+    e3.add<Shared<std::string>>("orc");
+    CHECK(&e1.get<Shared<std::string>>() == &e3.get<Shared<std::string>>());
+
+    e2.remove<Shared<UnitStats>>();
+    CHECK(e1.get<Shared<UnitStats>>().hp == 10);
+
+    Entity e4 = ecs.move_to_pool(e1, Pool::Dormant);
+    CHECK(e4.get<Shared<UnitStats>>().hp == 10);
+    CHECK(*e4.get_ptr<Shared<std::string>>() == "orc");
+    CHECK(e3.get<Shared<std::string>>() == "orc");
+
+    // }}}
+}
+
+TEST_CASE("split components") {
+    // {{{ ...
+
+    struct Motion { float x, vx; };
+    struct MotionInfo { std::string name; };
+    using Body = Split<Motion, MotionInfo>;
+    enum class Pool { Active, Dormant };
+    using MyECS = ECS<NoGlobal, NoMessageQueue, Pools<Pool, 2>, Body>;
+    MyECS ecs;
+
+    Entity e1 = ecs.add(Pool::Active),
+           e2 = ecs.add(Pool::Active),
+           e3 = ecs.add(Pool::Active);
+    e3.add<Body>(Motion { 3, 1 }, MotionInfo { "c" });
+    e2.add<Body>(Motion { 2, 1 });
+    e1.add<Body>(Motion { 1, 1 }, MotionInfo { "a" });
+    CHECK(e2.get<Body>().cold().name.empty());
+
+    for (auto& e: ecs.entities<Body>())
+        e.get<Body>().hot().x += e.get<Body>().hot().vx;
+    CHECK(e1.get<Body>().hot().x == 2);
+    CHECK(e3.get<Body>().cold().name == "c");
+    CHECK(e3.get_ptr<Body>()->hot().x == 4);
+
+    MyECS const& cecs = ecs;
+    CHECK(cecs.get<Body>(e1.id).cold().name == "a");
+
+    e2.remove<Body>();
+    CHECK(!e2.has<Body>());
+    CHECK(!e2.get_ptr<Body>());
+    ecs.move_many(std::vector { e1, e3 }, Pool::Dormant);
+    CHECK(ecs.get<Body>(e3.id).cold().name == "c");
+    CHECK(ecs.entities<Body>(Pool::Dormant).size() == 2);
+
+    // the components of the entities that don't move are kept
+    Entity e4 = ecs.add(Pool::Active);
+    e4.add<Body>(Motion { 4, 1 }, MotionInfo { "d" });
+    ecs.move_many(std::vector { e2 }, Pool::Dormant);
+    CHECK(e4.get<Body>().cold().name == "d");
+    CHECK(e4.get<Body>().hot().x == 4);
+
+    // }}}
+}
+
+struct Selected {};
+struct Note { std::string text; };
+struct Mesh { std::string vertices[8]; };
+template<> struct ecs::storage_traits<Note> { static constexpr Storage kind = Storage::Sparse; };
+
+TEST_CASE("storage policies") {
+    // {{{ ...
+
+    static_assert(storage_traits<Selected>::kind == Storage::Tag);
+    static_assert(storage_traits<Mesh>::kind == Storage::Stable);
+    static_assert(storage_traits<Direction>::kind == Storage::Dense);
+
+    enum class Pool { Active, Dormant };
+    ECS<NoGlobal, NoMessageQueue, Pools<Pool, 2>, Direction, Selected, Note, Mesh> ecs;
+
+    std::vector<Entity<decltype(ecs), Pool>> es;
+    for (int i = 0; i < 6; ++i)
+        es.push_back(ecs.add(Pool::Active));
+
+    Mesh& m5 = es[5].add<Mesh>();
+    m5.vertices[0] = "v";
+    for (int i = 4; i >= 0; --i) {
+        es[i].add<Mesh>();
+        es[i].add<Direction>("N");
+        if (i % 2 == 0)
+            es[i].add<Selected>();
+        if (i % 2 == 1)
+            es[i].add<Note>(std::to_string(i));
+    }
+    CHECK(&m5 == &es[5].get<Mesh>());   // stable address
+
+    CHECK(ecs.entities<Selected>().size() == 3);
+    CHECK(ecs.entities<Direction, Note>().size() == 2);
+    CHECK(ecs.entities<Selected, Mesh, Direction>().size() == 3);
+    CHECK(es[3].get<Note>().text == "3");
+    CHECK(es[2].has<Selected>());
+    CHECK(!es[3].has<Selected>());
+
+    es[0].remove<Selected>();
+    es[1].remove<Note>();
+    CHECK(ecs.entities<Selected>().size() == 2);
+    CHECK(ecs.entities<Note>().size() == 1);
+
+    ecs.move_many(std::vector { es[2], es[3], es[5] }, Pool::Dormant);
+    ecs.move_to_pool(es[4], Pool::Dormant);
+    CHECK(ecs.entities<Selected>(Pool::Dormant).size() == 2);
+    CHECK(ecs.get<Note>(es[3].id).text == "3");
+    CHECK(&ecs.get<Mesh>(es[5].id) == &m5);
+    CHECK(ecs.entities<Mesh>(Pool::Active).size() == 2);
+
+    Mesh& m0 = es[0].get<Mesh>();
+    m0.vertices[0] = "w";
+    auto e6 = ecs.add(Pool::Active);
+    ecs.move_many(std::vector { e6 }, Pool::Dormant);
+    CHECK(&es[0].get<Mesh>() == &m0);
+    CHECK(m0.vertices[0] == "w");
+    CHECK(es[1].get<Direction>().dir == "N");
+
+    // }}}
+}
+
+TEST_CASE("owning groups") {
+    // {{{ ...
+
+    struct P { int v; };
+    struct V { int v; };
+    struct M { int v; };
+    enum class Pool { Active, Dormant };
+    using MyECS = ECS<NoGlobal, NoMessageQueue, Pools<Pool, 2>, P, V, M>;
+    MyECS ecs;
+
+    std::vector<Entity<MyECS, Pool>> es;
+    for (int i = 0; i < 12; ++i) {
+        es.push_back(ecs.add(Pool::Active));
+        es[i].add<P>(i);
+        if (i % 2 == 0)
+            es[i].add<V>(i);
+    }
+    ecs.add_group<P, V, M>();
+    CHECK_THROWS_AS((ecs.add_group<P, M>()), ECSError);
+    for (int i = 11; i >= 0; i -= 3)
+        es[i].add<M>(i);   // 11, 8, 5, 2: only 8 and 2 have the three components
+
+    auto g = ecs.group<P, V, M>(Pool::Active);
+    REQUIRE(g.size() == 2);
+    CHECK(g.id(0) == es[2].id);
+    CHECK(g.id(1) == es[8].id);
+    for (size_t i = 0; i < g.size(); ++i)
+        CHECK(g.get<P>(i).v + g.get<V>(i).v == g.get<M>(i).v * 2);
+
+    // queries still find the entities in order
+    CHECK(ids(ecs.entities<P, V, M>()) == std::vector<size_t> { es[2].id, es[8].id });
+    CHECK(ids(ecs.entities<P, M>()) == std::vector<size_t> { es[2].id, es[5].id, es[8].id, es[11].id });
+    CHECK(ids(ecs.entities<V>()).size() == 6);
+    CHECK(es[5].get<P>().v == 5);
+    CHECK(es[8].get<V>().v == 8);
+
+    // a component in the group can't be added again
+    CHECK_THROWS_AS(es[2].add<P>(2), ECSError);
+    CHECK(ecs.count<P>() == 12);
+
+    // leaving and entering the group
+    es[8].remove<V>();
+    CHECK(ecs.group<P, V, M>(Pool::Active).size() == 1);
+    es[5].add<V>(5);
+    es[0].add<M>(0);
+    CHECK(ids(ecs.entities<P, V, M>()) == std::vector<size_t> { es[0].id, es[2].id, es[5].id });
+    ecs.remove(es[2]);
+    CHECK(ids(ecs.entities<P, V, M>()) == std::vector<size_t> { es[0].id, es[5].id });
+
+    // moving to other pools
+    ecs.move_to_pool(es[0], Pool::Dormant);
+    ecs.move_many(std::vector { es[5], es[6] }, Pool::Dormant);
+    CHECK(ecs.group<P, V, M>(Pool::Active).size() == 0);
+    CHECK(ecs.group<P, V, M>(Pool::Dormant).size() == 2);
+    CHECK(ids(ecs.entities<P, V>(Pool::Dormant)) == std::vector<size_t> { es[0].id, es[5].id, es[6].id });
+    CHECK(ecs.get<M>(es[5].id).v == 5);
+    CHECK(ids(ecs.entities<P>(Pool::Active)).size() == 8);
+
+    // }}}
+}
+
+TEST_CASE("cached queries") {
+    // {{{ ...
+
+    enum class Pool { Active, Dormant };
+    using MyECS = ECS<NoGlobal, NoMessageQueue, Pools<Pool, 2>, Position, Direction>;
+    MyECS ecs;
+
+    Entity e1 = ecs.add(Pool::Active),
+           e2 = ecs.add(Pool::Active);
+    e1.add<Position>(1, 1);
+    e2.add<Position>(2, 2);
+    e2.add<Direction>("N");
+
+    auto q = ecs.query<Position>();
+    auto q2 = ecs.query<Position, Direction>(Pool::Active);
+    auto all = ecs.query();
+    CHECK(q.size() == 2);
+    CHECK(q2.size() == 1);
+    CHECK(all.size() == 2);
+
+    // changing other components or values doesn't search again
+    auto const* data = q.entities().data();
+    e1.add<Direction>("S");
+    e1.get<Position>().x = 10;
+    CHECK(q.entities().data() == data);
+    CHECK(q2.size() == 2);
+
+    int sum = 0;
+    for (auto& e: q)
+        sum += e.get<Position>().x;
+    CHECK(sum == 12);
+
+    // structural changes update the result
+    Entity e3 = ecs.add(Pool::Dormant);
+    CHECK(all.size() == 3);
+    e3.add<Position>(3, 3);
+    CHECK(q.size() == 3);
+    e2.remove<Direction>();
+    CHECK(q2.size() == 1);
+    ecs.move_to_pool(e1, Pool::Dormant);
+    CHECK(q2.size() == 0);
+    CHECK(q.size() == 3);
+    ecs.remove(e3);
+    CHECK(q.size() == 2);
+    ecs.clear_pool(Pool::Dormant);
+    CHECK(q.size() == 1);
+    CHECK(all.size() == 1);
+
+    // }}}
+}
+
+TEST_CASE("filters") {
+    // {{{ ...
+
+    struct Frozen {};
+    struct Sprite { int id; };
+    using MyECS = ECS<NoGlobal, NoMessageQueue, NoPool, Position, Frozen, Sprite>;
+    MyECS ecs;
+
+    std::vector<Entity<MyECS, NoPool>> es;
+    for (int i = 0; i < 6; ++i) {
+        es.push_back(ecs.add());
+        es[i].add<Position>(i, 0);
+        if (i % 3 == 0)
+            es[i].add<Frozen>();
+        if (i % 2 == 0)
+            es[i].add<Sprite>(i);
+    }
+
+    CHECK(ids(ecs.entities<With<Position>, Without<Frozen>>()) == std::vector<size_t> { es[1].id, es[2].id, es[4].id, es[5].id });
+    CHECK(ids(ecs.entities<Sprite, Without<Frozen>>()) == std::vector<size_t> { es[2].id, es[4].id });
+    CHECK(ecs.entities<Position, Maybe<Sprite>>().size() == 6);
+
+    int positions = 0, sprites = 0;
+    ecs.each<Position, Without<Frozen>, Maybe<Sprite>>([&](auto& e, Position& pos, Sprite* sprite) {
+        CHECK(!e.template has<Frozen>());
+        positions += pos.x;
+        if (sprite)
+            sprites += sprite->id;
+        pos.y = 1;
+    });
+    CHECK(positions == 1 + 2 + 4 + 5);
+    CHECK(sprites == 2 + 4);
+    CHECK(es[5].get<Position>().y == 1);
+    CHECK(es[3].get<Position>().y == 0);
+
+    MyECS const& cecs = ecs;
+    size_t n = 0;
+    cecs.each<Frozen, Position>([&](auto const&, Frozen const&, Position const& pos) { n += static_cast<size_t>(pos.x); });
+    CHECK(n == 3);
+
+    auto q = ecs.query<Position, Without<Frozen>>();
+    CHECK(q.size() == 4);
+    es[1].add<Frozen>();
+    CHECK(q.size() == 3);
+
+    // }}}
+}
+
+struct Health { int hp; };
+template<> struct ecs::track_changes<Health> : std::true_type {};
+
+TEST_CASE("change detection") {
+    // {{{ ...
+
+    using MyECS = ECS<NoGlobal, NoMessageQueue, NoPool, Position, Health>;
+    MyECS ecs;
+
+    std::vector<Entity<MyECS, NoPool>> es;
+    for (int i = 0; i < 200; ++i) {
+        es.push_back(ecs.add());
+        es[i].add<Health>(100);
+        if (i % 2 == 0)
+            es[i].add<Position>(i, 0);
+    }
+
+    std::vector<size_t> added, changed, removed;
+    auto sync = [&](MyECS const& e) {
+        added.clear(); changed.clear();
+        for (auto const& ent: e.entities<Added<Health>>())
+            added.push_back(ent.id);
+        e.each<Changed<Health>, Position>([&](auto const& ent, Health const&, Position const&) { changed.push_back(ent.id); });
+        removed = e.removed<Health>();
+    };
+
+    // everything is new in the first run
+    ecs.run_st("sync", sync);
+    CHECK(added.size() == 200);
+    CHECK(changed.size() == 100);
+
+    ecs.run_st("sync", sync);
+    CHECK(added.empty());
+    CHECK(changed.empty());
+
+    // changes made by mutable access, outside of the system
+    es[4].get<Health>().hp = 50;
+    es[150].get<Health>().hp = 50;
+    es[151].get<Health>().hp = 50;   // no position
+    es[3].add<Position>(3, 0);
+    ecs.run_st("sync", sync);
+    CHECK(added.empty());
+    CHECK(changed == std::vector<size_t> { es[4].id, es[150].id });
+
+    // changes made by another system
+    ecs.run_mutable("damage", [](MyECS& e) {
+        e.each<Health, Position>([](auto&, Health& h, Position const&) { h.hp -= 1; });
+    });
+    es[5].remove<Health>();
+    ecs.add().add<Health>(10);
+    ecs.run_st("sync", sync);
+    CHECK(added.size() == 1);
+    CHECK(changed.size() == 101);
+    CHECK(removed == std::vector<size_t> { es[5].id });
+
+    // a system doesn't see its own changes
+    ecs.run_mutable("damage", [](MyECS& e) {
+        CHECK(e.entities<Changed<Health>>().size() == 1);
+        e.each<Health>([](auto&, Health& h) { h.hp -= 1; });
+    });
+    ecs.run_mutable("damage", [](MyECS& e) { CHECK(e.entities<Changed<Health>>().empty()); });
+
+    ecs.start_frame();
+    ecs.run_st("sync", sync);
+    CHECK(removed.empty());
+
+    // the ticks are indexed without the pool, when it's in the id
+    enum class Pool { A, B };
+    ECS<NoGlobal, NoMessageQueue, Pools<Pool, 2, PoolInId>, Health> pecs;
+    pecs.add(Pool::B).add<Health>(1);
+    auto h = pecs.add(Pool::B);
+    h.add<Health>(2);
+    pecs.run_st("sync", [](auto const& e) { CHECK(e.template entities<Changed<Health>>().size() == 2); });
+    h.get<Health>().hp = 3;
+    pecs.run_st("sync", [&](auto const& e) {
+        auto changed = e.template entities<Changed<Health>>(Pool::B);
+        REQUIRE(changed.size() == 1);
+        CHECK(changed[0].id == h.id);
+    });
+
+    // the systems running in parallel keep their own ticks
+    auto count_changed = +[](MyECS const& e, std::atomic<size_t>* n) { *n = e.entities<Changed<Health>>().size(); };
+    std::atomic<size_t> n1 { 0 }, n2 { 0 };
+    ecs.run_mt("count1", count_changed, &n1);
+    ecs.run_mt("count2", count_changed, &n2);
+    ecs.join();
+    CHECK(n1 == 200);
+    CHECK(n2 == 200);
+    es[0].get<Health>().hp = 1;
+    ecs.run_mt("count1", count_changed, &n1);
+    ecs.run_mt("count2", count_changed, &n2);
+    ecs.join();
+    CHECK(n1 == 1);
+    CHECK(n2 == 1);
+
+    // }}}
+}
+
+template<> struct ecs::observe<Position> : std::true_type {};
+
+TEST_CASE("observers") {
+    // {{{ ...
+
+    enum class Pool { Active, Inactive };
+    using MyECS = ECS<NoGlobal, NoMessageQueue, Pools<Pool, 2>, Position, Direction>;
+    MyECS ecs;
+
+    // an external index, kept in sync by the observers
+    std::map<size_t, int> xs;
+    ecs.on_add<Position>([&](auto& e) { xs[e.id] = e.template get<Position>().x; });
+    ecs.on_remove<Position>([&](auto& e) { CHECK(e.template has<Position>()); xs.erase(e.id); });
+
+    std::vector<size_t> added, removed;
+    ecs.on_add_batch<Position>([&](std::vector<size_t> const& ids) { added.insert(added.end(), ids.begin(), ids.end()); });
+    ecs.on_remove_batch<Position>([&](std::vector<size_t> const& ids) { removed.insert(removed.end(), ids.begin(), ids.end()); });
+
+    auto e1 = ecs.add(Pool::Active), e2 = ecs.add(Pool::Active), e3 = ecs.add(Pool::Inactive);
+    e1.add<Position>(1, 0);
+    e2.add<Position>(2, 0);
+    e3.add<Position>(3, 0);
+    e1.add<Direction>("N");     // not observed
+    CHECK(xs == std::map<size_t, int> { { e1.id, 1 }, { e2.id, 2 }, { e3.id, 3 } });
+    CHECK(added.empty());
+
+    ecs.flush_observers();
+    CHECK(added == std::vector<size_t> { e1.id, e2.id, e3.id });
+
+    e1.remove<Position>();
+    ecs.remove(e2);
+    CHECK(xs == std::map<size_t, int> { { e3.id, 3 } });
+
+    // the batches are delivered after run_mutable
+    ecs.run_mutable("clear", [](MyECS& e) { e.clear_pool(Pool::Inactive); });
+    CHECK(xs.empty());
+    CHECK(removed == std::vector<size_t> { e1.id, e2.id, e3.id });
+
+    // an observer that adds another component
+    ecs.on_add<Position>([](auto& e) { if (!e.template has<Direction>()) e.template add<Direction>("S"); });
+    auto e4 = ecs.add(Pool::Active);
+    CHECK(e4.add<Position>(4, 0).x == 4);
+    CHECK(e4.get<Direction>().dir == "S");
+
+    // observers that remove the component they are notified about
+    MyECS ecs2;
+    ecs2.on_add<Position>([](auto& e) { if (e.template get<Position>().x < 0) e.template remove<Position>(); });
+    auto e5 = ecs2.add(Pool::Active);
+    CHECK_THROWS_AS(e5.add<Position>(-1, 0), ECSError);
+    CHECK(!e5.has<Position>());
+    CHECK(e5.add<Position>(1, 0).x == 1);
+
+    bool removing = false;
+    ecs2.on_remove<Position>([&](auto& e) {
+        if (!std::exchange(removing, true))
+            e.template remove<Position>();
+        removing = false;
+    });
+    e5.remove<Position>();
+    CHECK(!e5.has<Position>());
+    CHECK(ecs2.count<Position>() == 0);
+
+    // }}}
+}
+
+TEST_CASE("join order") {
+    // {{{ ...
+
+    struct Many { int v; };
+    struct Few {};
+    struct Other { int x; };
+    using MyECS = ECS<NoGlobal, NoMessageQueue, NoPool, Many, Few, Other>;
+    MyECS ecs;
+    ecs.add_group<Many, Other>();   // the ids of `Many` are split in two runs
+
+    std::vector<size_t> few, few_without_other;
+    for (int i = 0; i < 2000; ++i) {
+        auto e = ecs.add();
+        e.add<Many>(i);
+        if (i % 3 == 0)
+            e.add<Other>(i);
+        if (i % 97 == 0) {
+            e.add<Few>();
+            few.push_back(e.id);
+            if (i % 3 != 0)
+                few_without_other.push_back(e.id);
+        }
+    }
+
+    // the result doesn't depend on the order of the components
+    CHECK(sorted_ids(ecs.entities<Many, Few>()) == few);
+    CHECK(sorted_ids(ecs.entities<Few, Many>()) == few);
+    CHECK(sorted_ids(ecs.entities<Many, Few, Without<Other>>()) == few_without_other);
+    CHECK(sorted_ids(ecs.entities<Without<Other>, Few, Many>()) == few_without_other);
+    CHECK(sorted_ids(ecs.entities<Other, Few>()) == sorted_ids(ecs.entities<Few, Many, Other>()));
+
+    int sum = 0;
+    ecs.each<Many, Few>([&](auto&, Many const& m, Few const&) { sum += m.v; });
+    CHECK(sum == 97 * (20 * 21 / 2));
+
+    // }}}
+}
+
+TEST_CASE("id bitsets") {
+    // {{{ ...
+
+    IdBitset a, b, c;
+    for (size_t id: { 3, 70, 5000, 300000, 300001 })
+        a.set(id);
+    for (size_t id: { 70, 4999, 300000, 300001, 900000 })
+        b.set(id);
+    c.set(300000);
+    CHECK(a.test(5000));
+    CHECK(!a.test(5001));
+
+    std::array<IdBitset const*, 2> required {{ &a, &b }}, excluded {{ &c, nullptr }};
+    CHECK(IdBitset::next(required, 2, excluded, 0, 0) == 70);
+    CHECK(IdBitset::next(required, 2, excluded, 0, 71) == 300000);
+    CHECK(IdBitset::next(required, 2, excluded, 1, 71) == 300001);
+    CHECK(IdBitset::next(required, 2, excluded, 1, 300002) == IdBitset::npos);
+
+    b.reset(300001);
+    CHECK(IdBitset::next(required, 2, excluded, 1, 71) == IdBitset::npos);
+
+    // a sparse world, with the pool in the id
+    enum class Pool { Active, Inactive };
+    struct Rare {};
+    using MyECS = ECS<NoGlobal, NoMessageQueue, Pools<Pool, 2, PoolInId>, Position, Direction, Rare>;
+    MyECS ecs;
+    std::vector<size_t> expected;
+    for (int i = 0; i < 20000; ++i) {
+        auto e = ecs.add(i % 2 == 0 ? Pool::Active : Pool::Inactive);
+        e.add<Position>(i, 0);
+        if (i % 5000 == 0 || i == 12345) {
+            e.add<Rare>();
+            if (i % 2 == 0 && i != 10000)
+                expected.push_back(e.id);
+        }
+        if (i == 10000)
+            e.add<Direction>("N");
+    }
+    std::vector<size_t> found;
+    for (auto const& e: ecs.entities<Position, Rare, Without<Direction>>(Pool::Active))
+        found.push_back(e.id);
+    CHECK(found == expected);
+    CHECK(ecs.entities<Rare, Position>().size() == 5);
+
+    // }}}
+}
+
+TEST_CASE("count, any and first") {
+    // {{{ ...
+
+    enum class Pool { Units, Particles };
+    using MyECS = ECS<NoGlobal, NoMessageQueue, Pools<Pool, 2>, Position, Direction>;
+    MyECS ecs;
+
+    CHECK(ecs.count<Position>() == 0);
+    CHECK(!ecs.any<Position>());
+    CHECK(!ecs.first<Position>());
+
+    for (int i = 0; i < 10; ++i) {
+        auto e = ecs.add(i < 6 ? Pool::Units : Pool::Particles);
+        e.add<Position>(i, 0);
+        if (i % 4 == 0)
+            e.add<Direction>("N");
+    }
+
+    CHECK(ecs.count<Position>() == 10);
+    CHECK(ecs.count<Position>(Pool::Particles) == 4);
+    CHECK(ecs.count<Position, Direction>() == ecs.entities<Position, Direction>().size());
+    CHECK(ecs.count<Direction, Position>(Pool::Particles) == 1);
+    CHECK(ecs.count<Position, Without<Direction>>() == 7);
+
+    CHECK(ecs.any<Direction>());
+    CHECK(ecs.any<Direction>(Pool::Units));
+    ecs.add().add<Position>(0, 0);   // default pool
+    CHECK(ecs.any<Position, Without<Direction>>());
+    CHECK(ecs.count<Position>() == 11);
+
+    auto e = ecs.first<Direction>(Pool::Particles);
+    REQUIRE(e);
+    CHECK(e->get<Position>().x == 8);
+    e->get<Position>().x = 80;
+
+    MyECS const& cecs = ecs;
+    CHECK(cecs.first<Position, Direction>(Pool::Particles)->get<Position>().x == 80);
+
+    // }}}
+}
+
+TEST_CASE("iteration order") {
+    // {{{ ...
+
+    enum class Pool { A, B, C };
+    using MyECS = ECS<NoGlobal, NoMessageQueue, Pools<Pool, 3>, Position>;
+    MyECS ecs;
+
+    std::vector<Entity<MyECS, Pool>> es;
+    for (int i = 0; i < 30; ++i) {
+        es.push_back(ecs.add(static_cast<Pool>(i % 3)));
+        es.back().add<Position>(i, 0);
+    }
+    ecs.move_to_pool(es[4], Pool::C);
+    ecs.move_many(std::vector { es[0], es[3], es[27] }, Pool::B);
+    ecs.remove(es[10]);
+
+    // the entities of each pool are in ascending order
+    for (Pool pool: { Pool::A, Pool::B, Pool::C }) {
+        auto pool_ids = ids(ecs.entities(pool));
+        CHECK(std::is_sorted(pool_ids.begin(), pool_ids.end()));
+        CHECK(pool_ids == ids(ecs.entities<Position>(pool)));
+    }
+    CHECK(ids(ecs.entities(Pool::B)).front() == es[0].id);
+
+    // merged by id
+    auto all = ids(ecs.entities(Order::ById));
+    CHECK(all.size() == 29);
+    CHECK(std::is_sorted(all.begin(), all.end()));
+    CHECK(ids(ecs.entities<Position>(Order::ById)) == all);
+    CHECK(ids(ecs.entities(Order::ByPool)) == ids(ecs.entities()));
+
+    // }}}
+}
+
+TEST_CASE("collect") {
+    // {{{ ...
+
+    enum class Pool { Units, Particles };
+    using MyECS = ECS<NoGlobal, NoMessageQueue, Pools<Pool, 2>, Position, Direction>;
+    MyECS ecs;
+    for (int i = 0; i < 10; ++i) {
+        auto e = ecs.add(i % 2 == 0 ? Pool::Units : Pool::Particles);
+        e.add<Position>(i, 0);
+        if (i < 4)
+            e.add<Direction>("N");
+    }
+
+    std::vector<MyECS::EntityType> buffer;
+    ecs.collect<Position, Direction>(buffer);
+    CHECK(buffer == ecs.entities<Position, Direction>());
+    auto capacity = buffer.capacity();
+    auto data = buffer.data();
+
+    // the buffer is cleared, and its memory is reused
+    ecs.collect<Position>(Pool::Particles, buffer);
+    CHECK(buffer.size() == 5);
+    CHECK(buffer.capacity() == capacity);
+    CHECK(buffer.data() == data);
+    ecs.collect(buffer);
+    CHECK(buffer.size() == 10);
+
+    MyECS const& cecs = ecs;
+    std::vector<MyECS::ConstEntityType> cbuffer;
+    cecs.collect<Direction>(Pool::Units, cbuffer);
+    CHECK(cbuffer.size() == 2);
+
+    // output iterators
+    std::vector<MyECS::EntityType> out = ecs.entities(Pool::Units);
+    auto end = ecs.collect<Direction>(Pool::Particles, out.begin());
+    CHECK(end == out.begin() + 2);
+    CHECK(out[1].get<Position>().x == 3);
+
+    std::vector<MyECS::ConstEntityType> appended;
+    cecs.collect<Position, Without<Direction>>(std::back_inserter(appended));
+    CHECK(appended.size() == 6);
+
+    // }}}
+}
+
+TEST_CASE("get several components") {
+    // {{{ ...
+
+    struct Mass { float kg; };
+    using MyECS = ECS<NoGlobal, NoMessageQueue, NoPool, Position, Direction, Mass, Health>;
+    MyECS ecs;
+    auto e = ecs.add();
+    e.add<Position>(1, 2);
+    e.add<Direction>("N");
+    e.add<Health>(10);
+
+    auto [pos, dir] = e.get<Position, Direction>();
+    pos.x = 10;
+    dir.dir = "S";
+    CHECK(e.get<Position>().x == 10);
+    CHECK(e.get<Direction>().dir == "S");
+
+    auto const& ce = static_cast<MyECS::ConstEntityType const&>(e);
+    auto [cpos, cdir] = ce.get<Position, Direction>();
+    static_assert(std::is_same_v<decltype(ce.get<Position, Direction>()), std::tuple<Position const&, Direction const&>>);
+    CHECK(cpos.y == 2);
+    CHECK(cdir.dir == "S");
+
+    CHECK_THROWS_AS((e.get<Position, Mass>()), ECSError);
+    try {
+        e.get<Position, Mass, Direction>();
+    } catch (ECSError const& err) {
+        CHECK(std::string(err.what()).find("Mass") != std::string::npos);   // names the missing component
+    }
+
+    // a mutable access to several components marks the tracked ones as changed
+    ecs.run_st("sync", [](MyECS const& ecs) { CHECK(ecs.count<Changed<Health>>() == 1); });
+    ecs.run_st("sync", [](MyECS const& ecs) { CHECK(ecs.count<Changed<Health>>() == 0); });
+    std::get<1>(e.get<Position, Health>()).hp = 5;
+    ecs.run_st("sync", [](MyECS const& ecs) { CHECK(ecs.count<Changed<Health>>() == 1); });
+
+    // }}}
+}
+
 TEST_CASE("globals") {
     // {{{ ...
 
@@ -334,6 +1494,9 @@ struct D { D(D const&) = delete; };
 
 // ECS<NoGlobal, NoPool, int, A> e3;
 
+enum class OnePool { X };
+// ECS<NoGlobal, NoMessageQueue, Pools<OnePool, 1, PoolComponents<OnePool::X, B>>, A> e4;
+
 // int test() { ECS<NoGlobal, NoMessageQueue, NoPool, A> e; e.add_component<B>(ecs::Entity { 0 }); };
 
 // vim: ts=4:sw=4:sts=4:expandtab:foldmethod=marker